@@ -1,6 +1,8 @@
 #include "include/config.h"
 #include "include/Stack.h"
 #include "include/stack_hash.h"
+#include "include/stack_alloc.h"
+#include "include/trace.h"
 
 #ifndef __USE_MINGW_ANSI_STDIO
 #define __USE_MINGW_ANSI_STDIO 1
@@ -11,13 +13,39 @@
 #include <assert.h>
 
 static size_t stack_init_cap_(size_t capacity);
-static int stack_resize_(Stack* stk, size_t new_capacity);
+STACK_COLD static int stack_resize_(Stack* stk, size_t new_capacity);
+static void stack_move_lanes_(Elem_t* buffer, size_t old_cap, size_t new_cap);
 
-static void* recalloc(void* ptr, size_t* nobj, size_t new_nobj, size_t size);
+static size_t stack_buf_bytes_(size_t capacity);
+static void stack_unpoison_buf_(Stack* stk);
+static void stack_poison_free_(Stack* stk);
+static bool stack_fixed_(const Stack* stk);
+static Stack_alloc* stack_alloc_(const Stack* stk);
+
+#ifdef TRACE
+static uint64_t stack_trace_id_(const Stack* stk);
+#endif
+
+static void* recalloc(void* ptr, size_t* nobj, size_t new_nobj, size_t size, Stack_alloc* alloc);
+static void* stack_realloc_buf_(Stack* stk, void* ptr, size_t* nobj, size_t new_nobj, size_t size);
+
+#ifdef SNAPSHOT
+/// \brief Header written over retired buffer
+struct Stack_retired
+{
+    Stack_retired* next;
+    size_t nbytes;
+    int huge_used;
+};
+
+static void stack_retire_(Stack* stk, void* ptr, size_t nbytes, int huge_used);
+static void stack_free_retired_(Stack* stk);
+#endif // SNAPSHOT
 
 #define BUF_ (stk->buffer)
 #define SZ_ (stk->size)
 #define CAP_ (stk->capacity)
+#define LANE_(lane) (BUF_ + (lane) * CAP_)
 
 #ifdef DUMP
     #ifdef DUMP_ALL
@@ -32,7 +60,7 @@ static void* recalloc(void* ptr, size_t* nobj, size_t new_nobj, size_t size);
 #define ASSERT(condition, error)        \
     do                                  \
     {                                   \
-        if(!(condition))                \
+        if(STACK_UNLIKELY(!(condition)))\
         {                               \
             err |= error;               \
             DO_DUMP;                    \
@@ -44,12 +72,18 @@ static void* recalloc(void* ptr, size_t* nobj, size_t new_nobj, size_t size);
 #ifdef PROTECT 
 #ifdef STACK_HASH
     #define STK_HASH_ (stk->stk_hash)
+    #define INFO_HASH_ (stk->info_hash)
+    static uint32_t stack_hash_(const Stack* stk);
     static void stack_set_stkhash_(Stack* stk);
     static int stack_check_stkhash_(const Stack* stk);
+    static uint32_t stack_info_hash_(const Stack* stk);
+    static void stack_set_infohash_(Stack* stk);
+    static int stack_check_infoptr_(const Stack* stk);
 #endif // STACK_HASH
 
 #ifdef BUFFER_HASH
     #define BUF_HASH_ (stk->buf_hash)
+    static guard_t stack_buf_hash_(const Stack* stk);
     static void stack_set_bufhash_(Stack* stk);
     static int stack_check_bufhash_(const Stack* stk);
 #endif // BUFFER_HASH
@@ -58,21 +92,36 @@ static void* recalloc(void* ptr, size_t* nobj, size_t new_nobj, size_t size);
     #define BEG_STK_CAN_ (stk->beg_can)
     #define END_STK_CAN_ (stk->end_can)
     #define BEG_BUF_CAN_ (*(((guard_t*) BUF_) - 1))
-    #define END_BUF_CAN_ (*((guard_t*) (BUF_ + CAP_)))
+    #define END_BUF_CAN_ (*((guard_t*) (BUF_ + CAP_ * STACK_LANES)))
     static void stack_set_cans_(Stack* stk);
     static int stack_check_cans_(const Stack* stk);
 #endif // CANARY
 
 Stack_err stack_verify_(const Stack* const stk)
+{
+    int err = stack_check_(stk);
+
+    // Buffer can't be read if structure of stack is broken
+    if(err & (Stack_err::NULLPTR | Stack_err::SZ_OVR_CAP | Stack_err::DSTRCTED | Stack_err::BAD_BUF))
+        return (Stack_err) err;
+
+#ifdef BUFFER_HASH
+    err |= stack_check_bufhash_(stk);
+#endif
+
+    return (Stack_err) err;
+}
+
+Stack_err stack_check_(const Stack* const stk)
 {
     int err = Stack_err::NOERR;
-    
+
     if(!stk)
         return Stack_err::NULLPTR;
 
     if(SZ_ > CAP_)
         return Stack_err::SZ_OVR_CAP;
-    
+
     if(BUF_ == BUF_POISON)
         return Stack_err::DSTRCTED;
 
@@ -85,15 +134,29 @@ Stack_err stack_verify_(const Stack* const stk)
 #ifdef STACK_HASH
     err |= stack_check_stkhash_(stk);
 #endif
-#ifdef BUFFER_HASH
-    err |= stack_check_bufhash_(stk);
-#endif
 
     return (Stack_err) err;
 }
+
+Stack_err stack_check_info_(const Stack* const stk)
+{
+    if(!stk)
+        return Stack_err::NULLPTR;
+
+    if(BUF_ == BUF_POISON)
+        return Stack_err::DSTRCTED;
+
+#ifdef STACK_HASH
+    // Pointer is garbage in corrupted stack, so it is checked before record is hashed
+    if(stack_check_infoptr_(stk) || INFO_HASH_ != stack_info_hash_(stk))
+        return Stack_err::BAD_STK_HSH;
+#endif
+
+    return Stack_err::NOERR;
+}
 #endif // PROTECT ////////////////////////////////////////////////
 
-Stack_err stack_init_(Stack* stk, ssize_t preset_cap 
+Stack_err stack_init_(Stack* stk, ssize_t preset_cap, const Stack_alloc* alloc
               DUMP_ON(const char func[], const char file[], int line))
 {
     int err = Stack_err::NOERR;
@@ -105,29 +168,86 @@ Stack_err stack_init_(Stack* stk, ssize_t preset_cap
 
     ASSERT(!BUF_, Stack_err::REINIT);
 
+    ASSERT(!stk->info, Stack_err::REINIT);
+
 #ifdef HASH
     ASSERT(STK_HASH_, Stack_err::REINIT);
 #endif
 #endif // PROTECT
 
-    if(preset_cap)
+    stk->info = (Stack_info*) calloc(1, sizeof(Stack_info));
+    ASSERT(stk->info, Stack_err::BAD_ALLOC);
+
+    *stk->info = {};
+
+#ifdef TRACE
+    stk->info->trace_id = trace_new_id_();
+#endif
+
+    if(alloc)
+    {
+        stk->info->alloc = *alloc;
+        stk->info->alloc.huge_used = HUGE_NONE;
+        stk->info->alloc.node_used = STACK_NODE_ANY;
+
+        // Node of initializing thread is fixed, so buffer stays there after resizes from other threads
+        if(stk->info->alloc.node == STACK_NODE_LOCAL)
+            stk->info->alloc.node = stack_mem_local_node();
+    }
+
+#ifdef STACK_FIXED_CAP
+    preset_cap = STACK_FIXED_CAP;
+    stk->info->alloc.fixed = true;
+#endif
+
+    int resized = 0;
+
+    if(stack_fixed_(stk))
+    {
+        // Buffer is allocated and pre-faulted once, it is never resized later
+        size_t capacity = preset_cap > 0 ? preset_cap : STACK_MIN_CAP;
+
+        resized = stack_resize_(stk, capacity);
+    }
+    else if(preset_cap)
     {
         if(preset_cap < 0)
             preset_cap = 0;
         
         size_t capacity = stack_init_cap_(preset_cap);
 
-        ASSERT(stack_resize_(stk, capacity) == 0, Stack_err::BAD_ALLOC);        
+        resized = stack_resize_(stk, capacity);
+    }
+
+    if(STACK_UNLIKELY(resized != 0))
+    {
+        // Stack stays uninitialized, so cold record is freed
+        free(stk->info);
+        stk->info = nullptr;
+    }
+
+    ASSERT(resized == 0, Stack_err::BAD_ALLOC);
+
+    if(stack_fixed_(stk))
+    {
+        stack_unpoison_buf_(stk);
+#ifdef CANARY
+        stack_mem_prefault(&BEG_BUF_CAN_, stack_buf_bytes_(CAP_), stack_alloc_(stk));
+#else
+        stack_mem_prefault(BUF_, stack_buf_bytes_(CAP_), stack_alloc_(stk));
+#endif
+        stack_poison_free_(stk);
     }
 
 #ifdef PROTECT
 #ifdef DUMP
-    stk->init_func = func;
-    stk->init_file = file;
-    stk->init_line = line;
+    stk->info->init_func = func;
+    stk->info->init_file = file;
+    stk->info->init_line = line;
 #endif // DUMP
 
 #ifdef STACK_HASH
+    stack_set_infohash_(stk);
     stack_set_stkhash_(stk);
 #endif
 #ifdef BUFFER_HASH
@@ -138,9 +258,15 @@ Stack_err stack_init_(Stack* stk, ssize_t preset_cap
 #endif
 
     err |= stack_verify_(stk);
+    err |= stack_check_info_(stk);
     DO_DUMP;
 #endif // PROTECT
 
+#ifdef TRACE
+    if(!err)
+        trace_op_(TRACE_INIT, stack_trace_id_(stk), nullptr, preset_cap > 0 ? preset_cap : 0);
+#endif
+
     return (Stack_err) err;
 }
 
@@ -154,10 +280,27 @@ Stack_err stack_push_(Stack* stk, Elem_t elem
     ASSERT(!err, err);
 #endif // PROTECT
 
-    if(CAP_ == SZ_)
+    if(STACK_UNLIKELY(CAP_ == SZ_))
+    {
+        // Full stack of fixed capacity is expected state, it is not dumped (push stays bounded in time)
+        if(stack_fixed_(stk))
+            return Stack_err::STK_FULL;
+
+#ifdef PROTECT
+        // Cold record is read by resize, so it is verified only here
+        err = stack_check_info_(stk);
+        ASSERT(!err, err);
+#endif // PROTECT
+
         ASSERT(stack_resize_(stk, CAP_ * STACK_CAP_MULTPLR) == 0, Stack_err::BAD_ALLOC);
+    }
 
-    BUF_[SZ_++] = elem;
+    uint64_t seq = stack_write_begin_(stk);
+    stack_slot_use_(stk, SZ_);
+    BUF_[SZ_] = elem;
+    stack_aggr_push_(stk);
+    SZ_++;
+    stack_write_end_(stk, seq);
 
 #ifdef PROTECT
 #ifdef STACK_HASH
@@ -171,30 +314,54 @@ Stack_err stack_push_(Stack* stk, Elem_t elem
     DO_DUMP;
 #endif // PROTECT
 
+#ifdef TRACE
+    if(!err)
+        trace_op_(TRACE_PUSH, stack_trace_id_(stk), &elem, 0);
+#endif
+
     return (Stack_err) err;
 }
 
 Stack_err stack_pop_(Stack* stk, Elem_t* elem
              DUMP_ON(const char func[], const char file[], int line))
 {
-    int err = Stack_err::NOERR;
-
 #ifdef PROTECT
-    err = stack_verify_(stk);
+    int err = stack_verify_(stk);
     ASSERT(!err, err);
+#endif // PROTECT
+
+    return stack_pop_unchecked_(stk, elem DUMP_ON(func, file, line));
+}
 
+Stack_err stack_pop_unchecked_(Stack* stk, Elem_t* elem
+             DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
     ASSERT(elem, Stack_err::NULLPTR);
 #endif // PROTECT
     
     ASSERT(SZ_, Stack_err::POP_EMPT_STK);
 
+    uint64_t seq = stack_write_begin_(stk);
     *elem = BUF_[--SZ_];
+    stack_slot_free_(stk, SZ_);
+    stack_write_end_(stk, seq);
 
 #ifdef PROTECT
-    memset(&BUF_[SZ_], BYTE_POISON, sizeof(Elem_t));
+    if(STACK_UNLIKELY(SZ_ * STACK_CAP_MULTPLR * STACK_CAP_MULTPLR <= CAP_) && CAP_ > STACK_MIN_CAP &&
+       !stack_fixed_(stk))
+    {
+#ifdef STACK_HASH
+        // Info pointer is checked with stack hash, which is stale after size is changed
+        stack_set_stkhash_(stk);
+#endif
+        err = stack_check_info_(stk);
+        ASSERT(!err, err);
 
-    if(SZ_ * STACK_CAP_MULTPLR * STACK_CAP_MULTPLR <= CAP_)
         ASSERT(stack_resize_(stk, CAP_ / STACK_CAP_MULTPLR) == 0, Stack_err::BAD_ALLOC);
+    }
 
 #ifdef BUFFER_HASH
     stack_set_bufhash_(stk);
@@ -207,6 +374,11 @@ Stack_err stack_pop_(Stack* stk, Elem_t* elem
     DO_DUMP;
 #endif // PROTECT
 
+#ifdef TRACE
+    if(!err)
+        trace_op_(TRACE_POP, stack_trace_id_(stk), nullptr, 0);
+#endif
+
     return (Stack_err) err;
 }
 
@@ -215,14 +387,24 @@ Stack_err stack_dstr_(Stack* stk
 {
 #ifdef PROTECT
     int err = stack_verify_(stk);
+    err |= stack_check_info_(stk);
     
     ASSERT(BUF_ != BUF_POISON, Stack_err::DSTRCTED);
 
+#ifdef TRACE
+    trace_op_(TRACE_DSTR, stack_trace_id_(stk), nullptr, 0);
+#endif
+
+    size_t buf_bytes = stack_buf_bytes_(CAP_);
+
+    stack_unpoison_buf_(stk);
+
     CAP_ = SIZE_POISON;
     SZ_  = SIZE_POISON;
 
 #ifdef STACK_HASH
-    STK_HASH_ = SIZE_POISON;
+    STK_HASH_  = (uint32_t) SIZE_POISON;
+    INFO_HASH_ = (uint32_t) SIZE_POISON;
 #endif
 #ifdef BUFFER_HASH
     BUF_HASH_ = SIZE_POISON;
@@ -233,27 +415,49 @@ Stack_err stack_dstr_(Stack* stk
     END_STK_CAN_ = (guard_t) SIZE_POISON;
 #endif
 
-#ifdef DUMP
-    stk->init_file = nullptr;
-    stk->init_func = nullptr;
-    stk->init_line = -1;
-#endif // DUMP
-
     if(BUF_)
     {
 #ifdef CANARY
         BUF_ = (Elem_t*) &BEG_BUF_CAN_;
 #endif
 
-        free(BUF_);
+        stack_mem_free(BUF_, buf_bytes, stack_alloc_(stk));
     }
 
     memcpy(&BUF_, &BUF_POISON, sizeof(Elem_t*));
 
+    if(stk->info)
+    {
+#ifdef SNAPSHOT
+        stack_free_retired_(stk);
+#endif
+#ifdef DUMP
+        stk->info->init_file = nullptr;
+        stk->info->init_func = nullptr;
+        stk->info->init_line = -1;
+#endif // DUMP
+
+        free(stk->info);
+        stk->info = nullptr;
+    }
+
     DO_DUMP;
     return Stack_err::NOERR;
 #else /////////////////////
-    free(BUF_);
+#ifdef TRACE
+    trace_op_(TRACE_DSTR, stack_trace_id_(stk), nullptr, 0);
+#endif
+
+    stack_unpoison_buf_(stk);
+    stack_mem_free(BUF_, stack_buf_bytes_(CAP_), stack_alloc_(stk));
+
+#ifdef SNAPSHOT
+    if(stk->info)
+        stack_free_retired_(stk);
+#endif
+
+    free(stk->info);
+    stk->info = nullptr;
 
     return Stack_err::NOERR;
 #endif // PROTECT ///////////
@@ -268,55 +472,270 @@ static int stack_resize_(Stack* stk, size_t new_capacity)
     if(new_capacity == CAP_)
         return 0;
 
+    size_t old_capacity = CAP_;
+
+    uint64_t seq = stack_write_begin_(stk);
+
+    // Free slots are moved and copied, they are poisoned again at new offsets
+    stack_unpoison_buf_(stk);
+
+#ifdef SNAPSHOT
+    void* old_buffer = BUF_;
+#ifdef CANARY
+    if(old_buffer)
+        old_buffer = ((char*) old_buffer) - sizeof(guard_t);
+#endif
+    int old_huge = stack_alloc_(stk) ? stack_alloc_(stk)->huge_used : HUGE_NONE;
+#endif // SNAPSHOT
+
+    // Aggregate lanes are moved to new offsets before shrinking and after growing
+    if(BUF_ && new_capacity < old_capacity)
+        stack_move_lanes_(BUF_, old_capacity, new_capacity);
+
 #ifdef CANARY
     void* temp_buffer = nullptr;
     size_t byte_cap = 0;
-    size_t byte_new_cap = new_capacity * sizeof(Elem_t) + 2 * sizeof(guard_t);
+    size_t byte_new_cap = stack_buf_bytes_(new_capacity);
 
     if(BUF_)
     {
         temp_buffer = ((char*) BUF_) - sizeof(guard_t);
-        byte_cap = CAP_ * sizeof(Elem_t) + 2 * sizeof(guard_t);
+        byte_cap = stack_buf_bytes_(CAP_);
     }
 
-    temp_buffer = recalloc(temp_buffer, &byte_cap, byte_new_cap, 1);
+    temp_buffer = stack_realloc_buf_(stk, temp_buffer, &byte_cap, byte_new_cap, 1);
 
     if(temp_buffer == nullptr)
+    {
+        if(BUF_ && new_capacity < old_capacity)
+            stack_move_lanes_(BUF_, new_capacity, old_capacity);
+
+        stack_poison_free_(stk);
+        stack_write_end_(stk, seq);
         return -1;
+    }
 
     temp_buffer = (void*) ((char*) temp_buffer + sizeof(guard_t));
-    byte_cap = (byte_cap - 2 * sizeof(guard_t)) / (sizeof(Elem_t));
+    byte_cap = (byte_cap - 2 * sizeof(guard_t)) / (STACK_LANES * sizeof(Elem_t));
     CAP_ = byte_cap;
     BUF_ = (Elem_t*) temp_buffer;
-
-    stack_set_cans_(stk);
 #else /////////////////////
-    Elem_t* temp_buffer = (Elem_t*) recalloc(BUF_, &CAP_, new_capacity, sizeof(Elem_t));
+    Elem_t* temp_buffer = (Elem_t*) stack_realloc_buf_(stk, BUF_, &CAP_, new_capacity, STACK_LANES * sizeof(Elem_t));
 
     if(temp_buffer == nullptr)
+    {
+        if(BUF_ && new_capacity < old_capacity)
+            stack_move_lanes_(BUF_, new_capacity, old_capacity);
+
+        stack_poison_free_(stk);
+        stack_write_end_(stk, seq);
         return -1;
+    }
 
     BUF_ = temp_buffer;
 #endif // CANARY //////////
 
+    if(old_capacity && new_capacity > old_capacity)
+        stack_move_lanes_(BUF_, old_capacity, new_capacity);
+
+#ifdef CANARY
+    stack_set_cans_(stk);
+#endif
+
+#ifdef SNAPSHOT
+    if(old_buffer)
+        stack_retire_(stk, old_buffer, stack_buf_bytes_(old_capacity), old_huge);
+#endif
+
+    stack_poison_free_(stk);
+    stack_write_end_(stk, seq);
+
+#ifdef STACK_HASH
+    // Allocator updates placement of buffer in cold record
+    stack_set_infohash_(stk);
+#endif
+
     return 0;
 }
 
+static void stack_move_lanes_(Elem_t* buffer, size_t old_cap, size_t new_cap)
+{
+    assert(buffer);
+
+    if(STACK_LANES == 1)
+        return;
+
+    if(new_cap < old_cap)
+    {
+        for(size_t lane = 1; lane < STACK_LANES; lane++)
+            memmove(buffer + lane * new_cap, buffer + lane * old_cap, new_cap * sizeof(Elem_t));
+
+        return;
+    }
+
+    for(size_t lane = STACK_LANES - 1; lane > 0; lane--)
+        memmove(buffer + lane * new_cap, buffer + lane * old_cap, old_cap * sizeof(Elem_t));
+
+#ifdef POISON_EAGER
+    for(size_t lane = 0; lane < STACK_LANES; lane++)
+        memset(buffer + lane * new_cap + old_cap, BYTE_POISON, (new_cap - old_cap) * sizeof(Elem_t));
+#endif
+}
+
+Stack_err stack_top_(const Stack* stk, Elem_t* elem
+             DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
+    err = stack_check_(stk);
+    ASSERT(!err, err);
+
+    ASSERT(elem, Stack_err::NULLPTR);
+#endif // PROTECT
+
+    ASSERT(SZ_, Stack_err::EMPT_STK);
+
+    *elem = BUF_[SZ_ - 1];
+
+    return Stack_err::NOERR;
+}
+
+Stack_err stack_peek_(const Stack* stk, size_t depth, Elem_t* elem
+             DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
+    err = stack_check_(stk);
+    ASSERT(!err, err);
+
+    ASSERT(elem, Stack_err::NULLPTR);
+#endif // PROTECT
+
+    ASSERT(SZ_, Stack_err::EMPT_STK);
+
+    ASSERT(depth < SZ_, Stack_err::BAD_ARG);
+
+    *elem = BUF_[SZ_ - 1 - depth];
+
+    return Stack_err::NOERR;
+}
+
+Stack_err stack_span_(const Stack* stk, Stack_span* span
+             DUMP_ON(const char func[], const char file[], int line))
+{
+#ifdef PROTECT
+    int err = stack_check_(stk);
+    ASSERT(!err, err);
+
+    ASSERT(span, Stack_err::NULLPTR);
+#endif // PROTECT
+
+    span->data = BUF_;
+    span->size = SZ_;
+
+    return Stack_err::NOERR;
+}
+
+Stack_err stack_aggr_(const Stack* stk, Stack_lane lane, Elem_t* val
+              DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
+    err = stack_check_(stk);
+    ASSERT(!err, err);
+
+    ASSERT(val, Stack_err::NULLPTR);
+#endif // PROTECT
+
+    assert(ELEM_LANE < lane && lane < STACK_LANES);
+
+    ASSERT(SZ_, Stack_err::EMPT_STK);
+
+    *val = LANE_(lane)[SZ_ - 1];
+
+    return Stack_err::NOERR;
+}
+
 ////////////////////////////////////////////////////////////////
 #ifdef PROTECT
 #ifdef STACK_HASH
+/// \brief Folds 64-bit hash to half of guard
+static uint32_t stack_fold_hash_(guard_t hash)
+{
+    return (uint32_t) (hash ^ (hash >> 32));
+}
+
+/// \brief Hash of fields from info_hash to info (cold record is covered by info_hash)
+static uint32_t stack_hash_(const Stack* stk)
+{
+    assert(stk);
+
+    const size_t HOT_BEG = offsetof(Stack, info_hash);
+#ifdef SNAPSHOT
+    const size_t HOT_END = offsetof(Stack, seq);
+#else
+    const size_t HOT_END = offsetof(Stack, info) + sizeof(Stack_info*);
+#endif
+
+    return stack_fold_hash_(qhashfnv1_64(((const char*) stk) + HOT_BEG, HOT_END - HOT_BEG));
+}
+
+/// \brief Hash of info pointer and of cold record pointed by it
+static uint32_t stack_info_hash_(const Stack* stk)
+{
+    assert(stk);
+
+    const size_t INFO_SZ = sizeof(Stack_info);
+
+    guard_t hash = qhashfnv1_64(&stk->info, sizeof(Stack_info*));
+
+    if(stk->info)
+        hash = (hash * 0x100000001B3) ^ qhashfnv1_64(stk->info, INFO_SZ);
+
+    return stack_fold_hash_(hash);
+}
+
+static void stack_set_infohash_(Stack* stk)
+{
+    assert(stk);
+
+    INFO_HASH_ = stack_info_hash_(stk);
+#ifdef SNAPSHOT
+    stk->info_ptr_hash = stack_fold_hash_(qhashfnv1_64(&stk->info, sizeof(Stack_info*)));
+#endif
+}
+
+/// \brief Checks info pointer without reading record it points to
+static int stack_check_infoptr_(const Stack* stk)
+{
+    assert(stk);
+
+#ifdef SNAPSHOT
+    if(stk->info_ptr_hash != stack_fold_hash_(qhashfnv1_64(&stk->info, sizeof(Stack_info*))))
+        return Stack_err::BAD_STK_HSH;
+
+    return Stack_err::NOERR;
+#else
+    // Stack hash covers info pointer
+    return stack_check_stkhash_(stk);
+#endif // SNAPSHOT
+}
+
 static void stack_set_stkhash_(Stack* stk)
 {
     assert(stk);
     
-    STK_HASH_ = qhashfnv1_64(((char*) stk) + 2 * sizeof(guard_t), sizeof(Stack) - 4 * sizeof(guard_t));
+    STK_HASH_ = stack_hash_(stk);
 }
 
 static int stack_check_stkhash_(const Stack* stk)
 {
     assert(stk);
 
-    if(STK_HASH_ != qhashfnv1_64(((const char*) stk) + 2 * sizeof(guard_t), sizeof(Stack) - 4 * sizeof(guard_t)))
+    if(STK_HASH_ != stack_hash_(stk))
         return Stack_err::BAD_STK_HSH;
 
     return Stack_err::NOERR;
@@ -324,10 +743,27 @@ static int stack_check_stkhash_(const Stack* stk)
 #endif // STACK_HASH
 
 #ifdef BUFFER_HASH
+/// \brief Hash of buffer (free slots are hashed only with POISON_EAGER, otherwise they are not initialized)
+static guard_t stack_buf_hash_(const Stack* stk)
+{
+    assert(stk);
+
+#ifdef POISON_EAGER
+    return qhashfnv1_64(BUF_, CAP_ * STACK_LANES * sizeof(Elem_t));
+#else
+    guard_t hash = qhashfnv1_64(BUF_, SZ_ * sizeof(Elem_t));
+
+    for(size_t lane = 1; lane < STACK_LANES; lane++)
+        hash = (hash * 0x100000001B3) ^ qhashfnv1_64(LANE_(lane), SZ_ * sizeof(Elem_t));
+
+    return hash;
+#endif // POISON_EAGER
+}
+
 static void stack_set_bufhash_(Stack* stk)
 {
     assert(stk);
-    BUF_HASH_ = qhashfnv1_64(BUF_, CAP_ * sizeof(Elem_t));
+    BUF_HASH_ = stack_buf_hash_(stk);
 }
 
 static int stack_check_bufhash_(const Stack* stk)
@@ -335,7 +771,7 @@ static int stack_check_bufhash_(const Stack* stk)
     assert(stk);
 
     if(BUF_)
-        if(BUF_HASH_ != qhashfnv1_64(BUF_, CAP_ * sizeof(Elem_t)))
+        if(BUF_HASH_ != stack_buf_hash_(stk))
             return Stack_err::BAD_BUF_HSH;
 
     return Stack_err::NOERR;
@@ -388,23 +824,232 @@ static size_t stack_init_cap_(size_t capacity)
     return iter;
 }
 
-static void* recalloc(void* ptr, size_t* nobj, size_t new_nobj, size_t size)
+static bool stack_fixed_(const Stack* stk)
+{
+    assert(stk);
+
+#ifdef STACK_FIXED_CAP
+    return true;
+#else
+    return stk->info && stk->info->alloc.fixed;
+#endif // STACK_FIXED_CAP
+}
+
+/// \brief Placement options of stack (nullptr if stack was not initialized, default allocation is used then)
+static Stack_alloc* stack_alloc_(const Stack* stk)
+{
+    assert(stk);
+
+    return stk->info ? &stk->info->alloc : nullptr;
+}
+
+/// \brief Size of buffer allocation in bytes (including canaries)
+static size_t stack_buf_bytes_(size_t capacity)
+{
+#ifdef CANARY
+    return capacity * STACK_LANES * sizeof(Elem_t) + 2 * sizeof(guard_t);
+#else
+    return capacity * STACK_LANES * sizeof(Elem_t);
+#endif
+}
+
+static void* recalloc(void* ptr, size_t* nobj, size_t new_nobj, size_t size, Stack_alloc* alloc)
 {
     assert(nobj);
     
     if(new_nobj == 0 || size == 0)
     {
-        free(ptr);
+        stack_mem_free(ptr, (*nobj) * size, alloc);
         return nullptr;
     }
 
-    char* new_ptr = (char*) realloc(ptr, new_nobj * size);
+    char* new_ptr = (char*) stack_mem_realloc(ptr, (*nobj) * size, new_nobj * size, alloc);
     if(new_ptr == nullptr)
         return nullptr;
+#ifdef POISON_EAGER
     if(new_nobj > *nobj)
         memset(new_ptr + (*nobj) * size, BYTE_POISON, (new_nobj - (*nobj)) * size);
+#endif
+
+    *nobj = new_nobj;
+
+    return new_ptr;
+}
+
+#ifdef POISON_ASAN
+/// \brief Checks that buffer of stack is not freed by stack_dstr
+static bool stack_dstred_(const Stack* stk)
+{
+#ifdef PROTECT
+    return BUF_ == BUF_POISON;
+#else
+    return false;
+#endif
+}
+#endif // POISON_ASAN
+
+/// \brief Makes whole buffer addressable (POISON_ASAN only)
+static void stack_unpoison_buf_(Stack* stk)
+{
+    assert(stk);
+
+#ifdef POISON_ASAN
+    if(BUF_ && !stack_dstred_(stk))
+        ASAN_UNPOISON_MEMORY_REGION(BUF_, CAP_ * STACK_LANES * sizeof(Elem_t));
+#endif
+}
+
+/// \brief Poisons slots above size of every lane (POISON_ASAN only)
+static void stack_poison_free_(Stack* stk)
+{
+    assert(stk);
+
+#ifdef POISON_ASAN
+    if(BUF_ && !stack_dstred_(stk) && SZ_ < CAP_)
+        for(size_t lane = 0; lane < STACK_LANES; lane++)
+            ASAN_POISON_MEMORY_REGION(LANE_(lane) + SZ_, (CAP_ - SZ_) * sizeof(Elem_t));
+#endif
+}
+
+/// \brief Reallocates buffer (with SNAPSHOT old buffer is not freed, it is retired by stack_resize_)
+static void* stack_realloc_buf_(Stack* stk, void* ptr, size_t* nobj, size_t new_nobj, size_t size)
+{
+    assert(stk && nobj);
+
+#ifdef SNAPSHOT
+    size_t old_nobj = *nobj;
+    size_t new_nobj_ = 0;
+
+    char* new_ptr = (char*) recalloc(nullptr, &new_nobj_, new_nobj, size, stack_alloc_(stk));
+    if(new_ptr == nullptr)
+        return nullptr;
+
+    if(ptr)
+        memcpy(new_ptr, ptr, (old_nobj < new_nobj ? old_nobj : new_nobj) * size);
 
     *nobj = new_nobj;
 
     return new_ptr;
+#else
+    return recalloc(ptr, nobj, new_nobj, size, stack_alloc_(stk));
+#endif // SNAPSHOT
+}
+
+////////////////////////////////////////////////////////////////
+#ifdef SNAPSHOT
+/// \brief Frees old buffer or keeps it until snapshots which may read it are finished
+static void stack_retire_(Stack* stk, void* ptr, size_t nbytes, int huge_used)
+{
+    assert(stk && stk->info && ptr);
+
+    // New buffer is published before readers are counted: snapshot started later reads only new buffer
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if(__atomic_load_n(&stk->readers, __ATOMIC_RELAXED) == 0)
+    {
+        Stack_alloc alloc = stk->info->alloc;
+        alloc.huge_used = huge_used;
+
+        stack_mem_free(ptr, nbytes, &alloc);
+        stack_free_retired_(stk);
+
+        return;
+    }
+
+    Stack_retired* node = (Stack_retired*) ptr;
+    node->next      = (Stack_retired*) stk->retired;
+    node->nbytes    = nbytes;
+    node->huge_used = huge_used;
+
+    stk->retired = node;
+}
+
+static void stack_free_retired_(Stack* stk)
+{
+    assert(stk && stk->info);
+
+    Stack_retired* node = (Stack_retired*) stk->retired;
+    while(node)
+    {
+        Stack_retired* next = node->next;
+
+        Stack_alloc alloc = stk->info->alloc;
+        alloc.huge_used = node->huge_used;
+        stack_mem_free(node, node->nbytes, &alloc);
+
+        node = next;
+    }
+
+    stk->retired = nullptr;
+}
+
+#ifdef POISON_ASAN
+// Torn snapshot may read slot popped meanwhile (it is retried then)
+__attribute__((no_sanitize_address))
+#endif
+Stack_err stack_snapshot(const Stack* stk, Stack_snapshot* snap, Elem_t elems[], size_t k)
+{
+    if(!stk || !snap || (k && !elems))
+        return Stack_err::NULLPTR;
+
+    *snap = {};
+
+    if(!__atomic_load_n(&stk->info, __ATOMIC_ACQUIRE))
+        return Stack_err::NOERR;
+
+    // Counter of readers is the only field changed by snapshot
+    int* readers = (int*) &stk->readers;
+
+    // Buffers replaced while snapshot is counted are retired, not freed
+    __atomic_add_fetch(readers, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    int err = Stack_err::STK_BUSY;
+
+    for(int tries = 0; tries < STACK_SNAPSHOT_TRIES; tries++)
+    {
+        uint64_t seq = __atomic_load_n(&stk->seq, __ATOMIC_ACQUIRE);
+        if(seq & 1)
+            continue;
+
+        const Elem_t* buffer = __atomic_load_n(&stk->buffer, __ATOMIC_RELAXED);
+        size_t size          = __atomic_load_n(&stk->size, __ATOMIC_RELAXED);
+        size_t capacity      = __atomic_load_n(&stk->capacity, __ATOMIC_RELAXED);
+
+        // Header is checked before elements are read, so buffer, size and capacity match each other
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&stk->seq, __ATOMIC_RELAXED) != seq)
+            continue;
+
+        size_t count = size < k ? size : k;
+        for(size_t i = 0; i < count; i++)
+            __atomic_load(&buffer[size - 1 - i], &elems[i], __ATOMIC_RELAXED);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&stk->seq, __ATOMIC_RELAXED) != seq)
+            continue;
+
+        snap->size     = size;
+        snap->capacity = capacity;
+        snap->count    = count;
+        snap->seq      = seq;
+
+        err = Stack_err::NOERR;
+        break;
+    }
+
+    __atomic_sub_fetch(readers, 1, __ATOMIC_SEQ_CST);
+
+    return (Stack_err) err;
+}
+#endif // SNAPSHOT ///////////////////////////////////////////////
+
+#ifdef TRACE
+/// \brief Id of stack in trace (0 if stack was not initialized)
+static uint64_t stack_trace_id_(const Stack* stk)
+{
+    assert(stk);
+
+    return stk->info ? stk->info->trace_id : 0;
 }
+#endif // TRACE
@@ -7,8 +7,87 @@
 #endif
 #include <stdio.h>
 #include <string.h>
+#include <stdarg.h>
 #include <assert.h>
 
+/// Space needed for fast formatting of double
+const size_t DOUBLE_FMT_SZ = 32;
+
+static size_t format_uint_(char dst[], uint64_t val, size_t width)
+{
+    assert(dst);
+
+    char digits[24] = {};
+    size_t ndigits = 0;
+
+    do
+    {
+        digits[ndigits++] = (char) ('0' + val % 10);
+        val /= 10;
+    } while(val);
+
+    size_t len = 0;
+    while(len + ndigits < width)
+        dst[len++] = ' ';
+
+    while(ndigits)
+        dst[len++] = digits[--ndigits];
+
+    return len;
+}
+
+size_t stack_format_double(char dst[], size_t dst_sz, const double* elem)
+{
+    assert(dst && elem);
+
+    double val = *elem;
+
+    if(dst_sz < DOUBLE_FMT_SZ || val != val || val - val != 0)
+    {
+        int nbytes = snprintf(dst, dst_sz, "%g", val);
+        if(nbytes < 0)
+            return 0;
+
+        return (size_t) nbytes < dst_sz ? (size_t) nbytes : dst_sz - 1;
+    }
+
+    size_t len = 0;
+    if(val < 0 || (val == 0 && 1 / val < 0))
+    {
+        dst[len++] = '-';
+        val = -val;
+    }
+
+    // Values out of range of fixed notation are rare, so snprintf is used for them
+    if(val >= 1e15 || (val != 0 && val < 1e-4))
+        return len + snprintf(dst + len, dst_sz - len, "%g", val);
+
+    const uint64_t FRAC_SCALE = 1000000;
+
+    uint64_t ipart = (uint64_t) val;
+    uint64_t fpart = (uint64_t) ((val - (double) ipart) * FRAC_SCALE + 0.5);
+    if(fpart >= FRAC_SCALE)
+    {
+        ipart++;
+        fpart -= FRAC_SCALE;
+    }
+
+    len += format_uint_(dst + len, ipart, 0);
+
+    if(fpart)
+    {
+        dst[len++] = '.';
+
+        for(uint64_t scale = FRAC_SCALE / 10; fpart; scale /= 10)
+        {
+            dst[len++] = (char) ('0' + fpart / scale);
+            fpart %= scale;
+        }
+    }
+
+    return len;
+}
+
 #ifdef DUMP
 
 static const char HTML_INTRO[] = "<html>"
@@ -46,47 +125,136 @@ static const char HTML_OK[] = "<strong class = \"ok\">"
                                 "ok"
                               "</strong>";
 
-#define HTML_DUMP_MSG(MSG) fprintf(logstream, "%s%s %s", "<span class = title>", MSG, "</span>")
+#define HTML_DUMP_MSG(MSG) dbuf_printf_(dbuf, "%s%s %s", "<span class = title>", MSG, "</span>")
 
 static FILE* DUMP_STREAM = nullptr;
 static void (*PRINT_ELEM)(FILE*, const Elem_t*) = nullptr;
+static size_t (*FORMAT_ELEM)(char[], size_t, const Elem_t*) = nullptr;
+
+/// Size of buffer for dump formatting
+const size_t DUMP_BUF_SZ  = 1 << 16;
+/// Space reserved for one formatted element
+const size_t ELEM_FMT_SZ  = 64;
+/// Space reserved for slot prefix of element ("    #", index of up to 20 digits and ": ")
+const size_t ELEM_PREFIX_SZ = 5 + 20 + 2;
+
+/// \brief Buffer collecting dump before writing it to stream in bulk
+struct Dump_buf
+{
+    FILE*  stream;
+    size_t len;
+    char   data[DUMP_BUF_SZ];
+};
 
-//WARNING: not checked against overflow
-const size_t ERR_MSG_SZ = 4096;
+static Dump_buf DUMP_BUF = {};
 
-static void set_message_(char err_msg[], Stack_err err)
+static void dbuf_flush_(Dump_buf* dbuf)
 {
-    if(err == Stack_err::NOERR)
+    assert(dbuf);
+
+    if(dbuf->len)
+        fwrite(dbuf->data, 1, dbuf->len, dbuf->stream);
+
+    dbuf->len = 0;
+}
+
+static char* dbuf_reserve_(Dump_buf* dbuf, size_t nbytes)
+{
+    assert(dbuf && nbytes <= DUMP_BUF_SZ);
+
+    if(dbuf->len + nbytes > DUMP_BUF_SZ)
+        dbuf_flush_(dbuf);
+
+    return dbuf->data + dbuf->len;
+}
+
+static void dbuf_write_(Dump_buf* dbuf, const char str[], size_t nbytes)
+{
+    assert(dbuf && str);
+
+    if(nbytes > DUMP_BUF_SZ)
+    {
+        dbuf_flush_(dbuf);
+        fwrite(str, 1, nbytes, dbuf->stream);
+        return;
+    }
+
+    memcpy(dbuf_reserve_(dbuf, nbytes), str, nbytes);
+    dbuf->len += nbytes;
+}
+
+static void dbuf_printf_(Dump_buf* dbuf, const char format[], ...)
+{
+    assert(dbuf && format);
+
+    va_list args;
+
+    va_start(args, format);
+    int nbytes = vsnprintf(dbuf->data + dbuf->len, DUMP_BUF_SZ - dbuf->len, format, args);
+    va_end(args);
+
+    if(nbytes < 0)
         return;
 
-    err_msg[0] = '\0';
-
-    if(err & BAD_ALLOC)
-        strcat(err_msg, BAD_ALLOCATION);
-    if(err & BAD_BUF)
-        strcat(err_msg, BAD_BUFFER);
-    if(err & BAD_STK_HSH)
-        strcat(err_msg, BAD_STACK_HASH);
-    if(err & BAD_BUF_HSH)
-        strcat(err_msg, BAD_BUFFER_HASH);
-    if(err & BAD_STK_CAN)
-        strcat(err_msg, BAD_STACK_CANARY);
-    if(err & BAD_BUF_CAN)
-        strcat(err_msg, BAD_BUFFER_CANARY);
-    if(err & REINIT)
-        strcat(err_msg, REINITIALIZING);
-    if(err & REDESTR)
-        strcat(err_msg, REDESTRUCTING);
-    if(err & DSTRCTED)
-        strcat(err_msg, DESTRUCTED);
-    if(err & SZ_OVR_CAP)
-        strcat(err_msg, SIZE_OVER_CAP);
-    if(err & CAP_OVR_SZ)
-        strcat(err_msg, CAP_OVER_SIZE);
-    if(err & POP_EMPT_STK)
-        strcat(err_msg, POP_EMPTY_STACK);
-    if(err & NULLPTR)
-        strcat(err_msg, NULLPOINTER);
+    if(dbuf->len + nbytes < DUMP_BUF_SZ)
+    {
+        dbuf->len += nbytes;
+        return;
+    }
+
+    dbuf_flush_(dbuf);
+
+    va_start(args, format);
+    if((size_t) nbytes < DUMP_BUF_SZ)
+        dbuf->len += vsnprintf(dbuf->data, DUMP_BUF_SZ, format, args);
+    else
+        vfprintf(dbuf->stream, format, args);
+    va_end(args);
+}
+
+/// \brief Message for every error bit
+struct Err_msg
+{
+    Stack_err   err;
+    const char* msg;
+    size_t      len;
+};
+
+#define ERR_MSG_(ERR, MSG) {ERR, MSG, sizeof(MSG) - 1}
+
+static const Err_msg ERR_MSGS[] = 
+{
+    ERR_MSG_(BAD_ALLOC,    BAD_ALLOCATION),
+    ERR_MSG_(BAD_BUF,      BAD_BUFFER),
+    ERR_MSG_(BAD_STK_HSH,  BAD_STACK_HASH),
+    ERR_MSG_(BAD_BUF_HSH,  BAD_BUFFER_HASH),
+    ERR_MSG_(BAD_STK_CAN,  BAD_STACK_CANARY),
+    ERR_MSG_(BAD_BUF_CAN,  BAD_BUFFER_CANARY),
+    ERR_MSG_(REINIT,       REINITIALIZING),
+    ERR_MSG_(REDESTR,      REDESTRUCTING),
+    ERR_MSG_(DSTRCTED,     DESTRUCTED),
+    ERR_MSG_(SZ_OVR_CAP,   SIZE_OVER_CAP),
+    ERR_MSG_(CAP_OVR_SZ,   CAP_OVER_SIZE),
+    ERR_MSG_(POP_EMPT_STK, POP_EMPTY_STACK),
+    ERR_MSG_(NULLPTR,      NULLPOINTER),
+    ERR_MSG_(BAD_TYPE,     TYPE_MISMATCH),
+    ERR_MSG_(EMPT_STK,     EMPTY_STACK),
+    ERR_MSG_(STK_FULL,     STACK_FULL),
+    ERR_MSG_(BAD_ARG,      BAD_ARGUMENT),
+    ERR_MSG_(STK_BUSY,     STACK_BUSY),
+};
+
+#undef ERR_MSG_
+
+static void write_message_(Dump_buf* dbuf, Stack_err err)
+{
+    assert(dbuf);
+
+    for(size_t iter = 0; iter < sizeof(ERR_MSGS) / sizeof(ERR_MSGS[0]); iter++)
+    {
+        if(err & ERR_MSGS[iter].err)
+            dbuf_write_(dbuf, ERR_MSGS[iter].msg, ERR_MSGS[iter].len);
+    }
 }
 
 #define BUF_ (stk->buffer)
@@ -104,111 +272,249 @@ static void set_message_(char err_msg[], Stack_err err)
     #define BEG_STK_CAN_ (stk->beg_can)
     #define END_STK_CAN_ (stk->end_can)
     #define BEG_BUF_CAN_ (*(((guard_t*) BUF_) - 1))
-    #define END_BUF_CAN_ (*((guard_t*) (BUF_ + CAP_)))
+    #define END_BUF_CAN_ (*((guard_t*) (BUF_ + CAP_ * STACK_LANES)))
 #endif // CANARY
 
-void dump_(const Stack* const stk,  Stack_err err, Stack_dump_lvl level, const char msg[],
-           const char func[], const char file[], int line)
+static void dump_elems_(Dump_buf* dbuf, const Stack* const stk, size_t from, size_t to)
+{
+    assert(dbuf && stk);
+
+    for(size_t iter = from; iter < to; iter++)
+    {
+        // Prefix, element and '\n'
+        char* ptr = dbuf_reserve_(dbuf, ELEM_PREFIX_SZ + ELEM_FMT_SZ + 1);
+        size_t len = 0;
+
+        memcpy(ptr, iter < SZ_ ? "    #" : "     ", 5);
+        len += 5;
+        len += format_uint_(ptr + len, iter, 7);
+        ptr[len++] = ':';
+        ptr[len++] = ' ';
+
+#ifndef POISON_EAGER
+        // Free slots are not initialized (or are poisoned for AddressSanitizer), so they are not read
+        if(iter >= SZ_)
+        {
+            memcpy(ptr + len, "free", 4);
+            len += 4;
+
+            ptr[len++] = '\n';
+            dbuf->len += len;
+            continue;
+        }
+#endif // POISON_EAGER
+
+        if(FORMAT_ELEM)
+        {
+            len += FORMAT_ELEM(ptr + len, ELEM_FMT_SZ, &BUF_[iter]);
+        }
+        else
+        {
+            dbuf->len += len;
+            len = 0;
+
+            dbuf_flush_(dbuf);
+            PRINT_ELEM(dbuf->stream, &BUF_[iter]);
+
+            ptr = dbuf->data;
+        }
+
+        ptr[len++] = '\n';
+        dbuf->len += len;
+    }
+}
+
+static void dump_elided_(Dump_buf* dbuf, const Stack* const stk, size_t from, size_t to)
+{
+    assert(dbuf && stk);
+
+    if(from >= to)
+        return;
+
+    size_t live = 0;
+    if(from < SZ_)
+        live = (to < SZ_ ? to : SZ_) - from;
+
+    dbuf_printf_(dbuf, "        ...  [%llu, %llu) elided: %llu in stack, %llu free\n",
+                 from, to, live, to - from - live);
+}
+
+static Dump_buf* dump_head_(const void* obj, const char name[], Stack_err err, Stack_dump_lvl* level,
+                            const char msg[], const char func[], const char file[], int line)
 {
     if(err)
-        level = Stack_dump_lvl::DETAILED;
+        *level = Stack_dump_lvl::DETAILED;
     
-    if(level == Stack_dump_lvl::ONLYERR)
-        return;
+    if(*level == Stack_dump_lvl::ONLYERR)
+        return nullptr;
 
     FILE* logstream = DUMP_STREAM;
     if(!logstream)
-        return;
+        return nullptr;
+
+    Dump_buf* dbuf = &DUMP_BUF;
+    dbuf->stream = logstream;
+    dbuf->len    = 0;
         
     if(msg[0])
     {
         HTML_DUMP_MSG(msg);
     }
     
-    fprintf(logstream, "Stack [%p] ", stk);
+    dbuf_printf_(dbuf, "%s [%p] ", name, obj);
     
     if(err)
     {
-        char err_msg[ERR_MSG_SZ];
-        set_message_(err_msg, err);
-
-        fprintf(logstream, "<span class = \"error\">ERROR (code %.4d)\n%s</span>", err, err_msg);
+        dbuf_printf_(dbuf, "<span class = \"error\">ERROR (code %.4d)\n", err);
+        write_message_(dbuf, err);
+        dbuf_printf_(dbuf, "</span>");
     }        
     else 
     {
-        fprintf(logstream, "%s\n", HTML_OK);
+        dbuf_printf_(dbuf, "%s\n", HTML_OK);
     }
 
-    if(level == Stack_dump_lvl::DETAILED)
+    if(*level == Stack_dump_lvl::DETAILED)
+    {
+        dbuf_printf_(dbuf, "    date:        %s %s\n", __DATE__, __TIME__);
+        dbuf_printf_(dbuf, "    called from: %s at %s (%d)\n", func, file, line);
+    }
+
+    return dbuf;
+}
+
+FILE* dump_begin_(const void* obj, const char name[], Stack_err err, Stack_dump_lvl level,
+                  const char msg[], const char func[], const char file[], int line)
+{
+    Dump_buf* dbuf = dump_head_(obj, name, err, &level, msg, func, file, line);
+    if(!dbuf)
+        return nullptr;
+
+    dbuf_flush_(dbuf);
+
+    if(level != Stack_dump_lvl::DETAILED)
+    {
+        fflush(dbuf->stream);
+        return nullptr;
+    }
+
+    return dbuf->stream;
+}
+
+void dump_elem_(FILE* stream, const Elem_t* elem)
+{
+    assert(stream && elem);
+
+    if(FORMAT_ELEM)
     {
-        fprintf(logstream, "    date:        %s %s\n", __DATE__, __TIME__);
-        fprintf(logstream, "    called from: %s at %s (%d)\n", func, file, line);
+        char str[ELEM_FMT_SZ + 1] = "";
+        size_t len = FORMAT_ELEM(str, ELEM_FMT_SZ, elem);
+
+        fwrite(str, 1, len, stream);
+    }
+    else if(PRINT_ELEM)
+        PRINT_ELEM(stream, elem);
+    else
+        fprintf(stream, "?");
+}
+
+void dump_(const Stack* const stk,  Stack_err err, Stack_dump_lvl level, const char msg[],
+           const char func[], const char file[], int line)
+{
+    Dump_buf* dbuf = dump_head_(stk, "Stack", err, &level, msg, func, file, line);
+    if(!dbuf)
+        return;
+
+    FILE* logstream = dbuf->stream;
 
+    if(level == Stack_dump_lvl::DETAILED)
+    {
         if(!stk)
-            fprintf(logstream, "    nullptr to stack\n");
+            dbuf_printf_(dbuf, "    nullptr to stack\n");
         else
         {
-            if(stk->init_func && stk->init_file && stk->init_line)
-                fprintf(logstream, "    initialized: %s at %s (%d)\n\n", stk->init_func, stk->init_file, stk->init_line);
+            // Record is read only if it and pointer to it match hashes (stack may be corrupted)
+            Stack_err info_err = stack_check_info_(stk);
+            const Stack_info* info = info_err ? nullptr : stk->info;
+            Stack_alloc alloc = info ? info->alloc : Stack_alloc {};
+
+            if(info && info->init_func && info->init_file && info->init_line)
+                dbuf_printf_(dbuf, "    initialized: %s at %s (%d)\n\n", info->init_func, info->init_file, info->init_line);
             else
-                fprintf(logstream, "    initialized: UNKNOWN\n\n");
+                dbuf_printf_(dbuf, "    initialized: UNKNOWN\n\n");
 
-            fprintf(logstream, "    buffer[%p]\n", BUF_);
-            fprintf(logstream, "    size          = %llu\n", SZ_);
-            fprintf(logstream, "    capacity      = %llu\n", CAP_);
+            dbuf_printf_(dbuf, "    buffer[%p]\n", BUF_);
+            dbuf_printf_(dbuf, "    size          = %llu\n", SZ_);
+            dbuf_printf_(dbuf, "    capacity      = %llu%s\n", CAP_, alloc.fixed ? " (fixed)" : "");
+            if(info_err == Stack_err::BAD_STK_HSH)
+                dbuf_printf_(dbuf, "    info[%p]: <span class = \"error\">CORRUPTED</span>\n", stk->info);
+            else
+                dbuf_printf_(dbuf, "    info[%p]\n", stk->info);
+
+            static const char* const HUGE_NAMES[] = {"regular", "transparent huge", "explicit huge"};
+            int huge_used = (unsigned) alloc.huge_used < 3 ? alloc.huge_used : HUGE_NONE;
 
-            fprintf(logstream, "    Guards:\n");
+            dbuf_printf_(dbuf, "    placement     = node %d (requested %d%s), %s pages\n",
+                         BUF_ != BUF_POISON ? stack_mem_node(BUF_) : STACK_NODE_ANY, alloc.node,
+                         alloc.node >= 0 && alloc.node_used != alloc.node ? ", not bound" : "",
+                         HUGE_NAMES[huge_used]);
+
+            dbuf_printf_(dbuf, "    Guards:\n");
 
 #ifdef CANARY
-            fprintf(logstream, "     stack  begin = %llx\n", BEG_STK_CAN_);
-            fprintf(logstream, "     stack  end   = %llx\n", END_STK_CAN_);
+            dbuf_printf_(dbuf, "     stack  begin = %llx\n", BEG_STK_CAN_);
+            dbuf_printf_(dbuf, "     stack  end   = %llx\n", END_STK_CAN_);
 
             if(BUF_ != BUF_POISON && BUF_)
             {
-                fprintf(logstream, "     buffer begin = %llx\n", BEG_BUF_CAN_);
-                fprintf(logstream, "     buffer end   = %llx\n", END_BUF_CAN_);
+                dbuf_printf_(dbuf, "     buffer begin = %llx\n", BEG_BUF_CAN_);
+                dbuf_printf_(dbuf, "     buffer end   = %llx\n", END_BUF_CAN_);
             }
 #endif
 
 #ifdef STACK_HASH
-            fprintf(logstream, "     stack  hash  = %llx\n", STK_HASH_);
+            dbuf_printf_(dbuf, "     stack  hash  = %x\n", STK_HASH_);
+            dbuf_printf_(dbuf, "     info   hash  = %x\n", stk->info_hash);
 #endif
 #ifdef BUFFER_HASH
-            fprintf(logstream, "     buffer hash  = %llx\n", BUF_HASH_);
+            dbuf_printf_(dbuf, "     buffer hash  = %llx\n", BUF_HASH_);
 #endif 
 
             if(BUF_ && BUF_ != BUF_POISON)
             {
-                if(!PRINT_ELEM)
+                if(!PRINT_ELEM && !FORMAT_ELEM)
                 {
-                    fprintf(logstream, "    NO FUNCTION FOR PRINTING (use stack_dump_set_print())\n\n");
+                    dbuf_printf_(dbuf, "    NO FUNCTION FOR PRINTING (use stack_dump_init() or stack_dump_set_format())\n\n");
+                    dbuf_flush_(dbuf);
                     fflush(logstream);
 
                     return;
                 }
                 
-                fprintf(logstream, "    {\n");
-
-                size_t iter = 0;
+                dbuf_printf_(dbuf, "    {\n");
 
-                while(iter < CAP_ || iter < SZ_)
-                {
-                    if(iter < SZ_)
-                        fprintf(logstream, "    #");
-                    else
-                        fprintf(logstream, "     ");
+                // Slots are printed in two windows: at the bottom of buffer and around the top of stack
+                size_t end      = CAP_ > SZ_ ? CAP_ : SZ_;
+                size_t head_end = DUMP_HEAD_ELEMS < end ? DUMP_HEAD_ELEMS : end;
+                size_t top_beg  = SZ_ > DUMP_TAIL_ELEMS ? SZ_ - DUMP_TAIL_ELEMS : 0;
+                size_t top_end  = end - SZ_ > DUMP_TAIL_ELEMS ? SZ_ + DUMP_TAIL_ELEMS : end;
 
-                    fprintf(logstream, "%7.1llu: ", iter);
-                    PRINT_ELEM(logstream, &stk->buffer[iter]);
-                    fprintf(logstream, "\n");
+                if(top_beg < head_end)
+                    top_beg = head_end;
+                if(top_end < top_beg)
+                    top_end = top_beg;
 
-                    iter++;
-                }
+                dump_elems_ (dbuf, stk, 0, head_end);
+                dump_elided_(dbuf, stk, head_end, top_beg);
+                dump_elems_ (dbuf, stk, top_beg, top_end);
+                dump_elided_(dbuf, stk, top_end, end);
 
-                fprintf(logstream, "    }\n");
+                dbuf_printf_(dbuf, "    }\n");
             }
         }
     }
+
+    dbuf_flush_(dbuf);
     fflush(logstream);
 }
 
@@ -250,12 +556,17 @@ void stack_dump_init(FILE* dumpstream, void (*print_func)(FILE*, const Elem_t*))
     return;
 }
 
+void stack_dump_set_format(size_t (*format_func)(char dst[], size_t dst_sz, const Elem_t* elem))
+{
+    FORMAT_ELEM = format_func;
+}
+
 Stack_err stack_dump_(const Stack* const stk, const char msg[],
                       const char func[], const char file[], int line)
 {
     assert(stk && msg && func && file && line);
 
-    Stack_err err = stack_verify_(stk);
+    Stack_err err = (Stack_err) (stack_verify_(stk) | stack_check_info_(stk));
     
     dump_(stk, err, Stack_dump_lvl::DETAILED, msg, func, file, line);
 
@@ -285,7 +596,13 @@ Stack_err stack_dump_(const Stack* const stk, const char msg[],
 
 void stack_dump_init(FILE* dumpstream, void (*print_func)(FILE*, const Elem_t*))
 {
-    void(0);
+    (void) dumpstream;
+    (void) print_func;
+}
+
+void stack_dump_set_format(size_t (*format_func)(char dst[], size_t dst_sz, const Elem_t* elem))
+{
+    (void) format_func;
 }
 
 #endif // DUMP
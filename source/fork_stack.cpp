@@ -0,0 +1,459 @@
+#include "include/config.h"
+#include "include/Stack.h"
+#include "include/fork_stack.h"
+#include "include/stack_hash.h"
+
+#ifndef __USE_MINGW_ANSI_STDIO
+#define __USE_MINGW_ANSI_STDIO 1
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+
+static Stack_chunk* fstack_new_chunk_(Stack_chunk* prev);
+static void fstack_release_(Stack_chunk* chunk);
+static void fstack_set_guards_(Fork_stack* stk);
+static void fstack_set_chunk_guards_(Stack_chunk* chunk);
+
+#ifdef DUMP
+static void fstack_dump_lvl_(const Fork_stack* const stk, Stack_err err, Stack_dump_lvl level, const char msg[],
+                             const char func[], const char file[], int line);
+
+    #ifdef DUMP_ALL
+        #define DO_DUMP fstack_dump_lvl_(stk, (Stack_err) err, Stack_dump_lvl::BRIEF, __func__, func, file, line)
+    #else
+        #define DO_DUMP fstack_dump_lvl_(stk, (Stack_err) err, Stack_dump_lvl::ONLYERR, __func__, func, file, line)
+    #endif // DUMP_ALL
+#else
+    #define DO_DUMP
+#endif // DUMP
+
+#define ASSERT(condition, error)        \
+    do                                  \
+    {                                   \
+        if(STACK_UNLIKELY(!(condition)))\
+        {                               \
+            err |= error;               \
+            DO_DUMP;                    \
+            return (Stack_err) err;     \
+        }                               \
+    } while(0)                          \
+
+#define TOP_ (stk->top)
+#define TOP_SZ_ (stk->top_size)
+#define SZ_ (stk->size)
+
+////////////////////////////////////////////////////////////////
+#ifdef PROTECT
+static Stack_chunk* const CHUNK_POISON = (Stack_chunk*) 0x000000000BAD;
+
+static guard_t fstack_hash_(const Fork_stack* stk)
+{
+    assert(stk);
+
+    return qhashfnv1_64(&stk->top, (const char*) (&stk->size + 1) - (const char*) &stk->top);
+}
+
+static Stack_err fstack_check_chunk_(const Stack_chunk* chunk)
+{
+    assert(chunk);
+
+    int err = Stack_err::NOERR;
+
+    if(!chunk->refs)
+        err |= Stack_err::BAD_BUF;
+#ifdef CANARY
+    if(chunk->beg_can != DEFAULT_CANARY || chunk->end_can != DEFAULT_CANARY)
+        err |= Stack_err::BAD_BUF_CAN;
+#endif
+#ifdef BUFFER_HASH
+    if(chunk->hash != qhashfnv1_64(chunk->elems, sizeof(chunk->elems)))
+        err |= Stack_err::BAD_BUF_HSH;
+#endif
+
+    return (Stack_err) err;
+}
+
+Stack_err fstack_verify_(const Fork_stack* const stk)
+{
+    int err = Stack_err::NOERR;
+
+    if(!stk)
+        return Stack_err::NULLPTR;
+
+    if(TOP_ == CHUNK_POISON)
+        return Stack_err::DSTRCTED;
+
+    if(TOP_SZ_ > FSTACK_CHUNK_CAP || TOP_SZ_ > SZ_)
+        return Stack_err::SZ_OVR_CAP;
+
+    if(!TOP_ && SZ_)
+        return Stack_err::BAD_BUF;
+
+#ifdef CANARY
+    if(stk->beg_can != DEFAULT_CANARY || stk->end_can != DEFAULT_CANARY)
+        err |= Stack_err::BAD_STK_CAN;
+#endif
+#ifdef STACK_HASH
+    if(stk->stk_hash != fstack_hash_(stk))
+        err |= Stack_err::BAD_STK_HSH;
+#endif
+
+    // Shared chunks are checked as well, all chunks below top are full
+    size_t size = TOP_SZ_;
+    for(const Stack_chunk* chunk = TOP_; chunk && !err; chunk = chunk->prev)
+    {
+        err |= fstack_check_chunk_(chunk);
+
+        if(chunk != TOP_)
+            size += FSTACK_CHUNK_CAP;
+    }
+
+    if(!err && size != SZ_)
+        err |= Stack_err::BAD_BUF;
+
+    return (Stack_err) err;
+}
+#endif // PROTECT ////////////////////////////////////////////////
+
+Stack_err fstack_init_(Fork_stack* stk
+              DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
+    ASSERT(stk, Stack_err::NULLPTR);
+
+    ASSERT(TOP_ != CHUNK_POISON, Stack_err::DSTRCTED);
+
+    ASSERT(!TOP_, Stack_err::REINIT);
+#endif // PROTECT
+
+    TOP_    = nullptr;
+    TOP_SZ_ = 0;
+    SZ_     = 0;
+
+    fstack_set_guards_(stk);
+
+#ifdef PROTECT
+    err |= fstack_verify_(stk);
+    DO_DUMP;
+#endif // PROTECT
+
+    return (Stack_err) err;
+}
+
+Stack_err fstack_fork_(Fork_stack* dst, Fork_stack* src
+              DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+    Fork_stack* stk = src;
+
+#ifdef PROTECT
+    err = fstack_verify_(src);
+    ASSERT(!err, err);
+#endif // PROTECT
+
+    stk = dst;
+
+#ifdef PROTECT
+    ASSERT(stk, Stack_err::NULLPTR);
+
+    ASSERT(TOP_ != CHUNK_POISON, Stack_err::DSTRCTED);
+
+    ASSERT(!TOP_, Stack_err::REINIT);
+#endif // PROTECT
+
+    TOP_    = src->top;
+    TOP_SZ_ = src->top_size;
+    SZ_     = src->size;
+
+    if(TOP_)
+        TOP_->refs++;
+
+    fstack_set_guards_(stk);
+
+#ifdef PROTECT
+    err |= fstack_verify_(stk);
+    DO_DUMP;
+#endif // PROTECT
+
+    return (Stack_err) err;
+}
+
+Stack_err fstack_push_(Fork_stack* stk, Elem_t elem
+              DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
+    err = fstack_verify_(stk);
+    ASSERT(!err, err);
+#endif // PROTECT
+
+    if(!TOP_ || TOP_SZ_ == FSTACK_CHUNK_CAP)
+    {
+        // Reference to previous top is passed to new chunk
+        Stack_chunk* chunk = fstack_new_chunk_(TOP_);
+        ASSERT(chunk, Stack_err::BAD_ALLOC);
+
+        TOP_    = chunk;
+        TOP_SZ_ = 0;
+    }
+    else if(TOP_->refs > 1)
+    {
+        Stack_chunk* chunk = fstack_new_chunk_(TOP_->prev);
+        ASSERT(chunk, Stack_err::BAD_ALLOC);
+
+        if(chunk->prev)
+            chunk->prev->refs++;
+
+        memcpy(chunk->elems, TOP_->elems, TOP_SZ_ * sizeof(Elem_t));
+
+        TOP_->refs--;
+        TOP_ = chunk;
+    }
+
+    TOP_->elems[TOP_SZ_++] = elem;
+    SZ_++;
+
+    fstack_set_chunk_guards_(TOP_);
+    fstack_set_guards_(stk);
+
+#ifdef PROTECT
+    err = fstack_verify_(stk);
+    DO_DUMP;
+#endif // PROTECT
+
+    return (Stack_err) err;
+}
+
+Stack_err fstack_pop_(Fork_stack* stk, Elem_t* elem
+             DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
+    err = fstack_verify_(stk);
+    ASSERT(!err, err);
+
+    ASSERT(elem, Stack_err::NULLPTR);
+#endif // PROTECT
+
+    ASSERT(SZ_, Stack_err::POP_EMPT_STK);
+
+    *elem = TOP_->elems[--TOP_SZ_];
+    SZ_--;
+
+    // Shared chunk is not changed, other stacks still see popped element
+    if(TOP_->refs == 1)
+    {
+#ifdef PROTECT
+        memset(&TOP_->elems[TOP_SZ_], BYTE_POISON, sizeof(Elem_t));
+#endif
+        fstack_set_chunk_guards_(TOP_);
+    }
+
+    if(TOP_SZ_ == 0)
+    {
+        Stack_chunk* prev = TOP_->prev;
+
+        if(prev && TOP_->refs > 1)
+            prev->refs++;
+
+        fstack_release_(TOP_);
+
+        TOP_    = prev;
+        TOP_SZ_ = prev ? FSTACK_CHUNK_CAP : 0;
+    }
+
+    fstack_set_guards_(stk);
+
+#ifdef PROTECT
+    err = fstack_verify_(stk);
+    DO_DUMP;
+#endif // PROTECT
+
+    return (Stack_err) err;
+}
+
+Stack_err fstack_dstr_(Fork_stack* stk
+              DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
+    err = fstack_verify_(stk);
+
+    ASSERT(stk, Stack_err::NULLPTR);
+
+    ASSERT(TOP_ != CHUNK_POISON, Stack_err::DSTRCTED);
+#endif // PROTECT
+
+    if(TOP_)
+    {
+        Stack_chunk* chunk = TOP_;
+        while(chunk && chunk->refs == 1)
+        {
+            Stack_chunk* prev = chunk->prev;
+            fstack_release_(chunk);
+            chunk = prev;
+        }
+
+        if(chunk)
+            fstack_release_(chunk);
+    }
+
+#ifdef PROTECT
+    TOP_    = CHUNK_POISON;
+    TOP_SZ_ = SIZE_POISON;
+    SZ_     = SIZE_POISON;
+
+#ifdef STACK_HASH
+    stk->stk_hash = SIZE_POISON;
+#endif
+#ifdef CANARY
+    stk->beg_can = (guard_t) SIZE_POISON;
+    stk->end_can = (guard_t) SIZE_POISON;
+#endif
+
+    DO_DUMP;
+#endif // PROTECT
+
+    return (Stack_err) err;
+}
+
+static Stack_chunk* fstack_new_chunk_(Stack_chunk* prev)
+{
+    Stack_chunk* chunk = (Stack_chunk*) calloc(1, sizeof(Stack_chunk));
+    if(!chunk)
+        return nullptr;
+
+    chunk->prev = prev;
+    chunk->refs = 1;
+
+    memset(chunk->elems, BYTE_POISON, sizeof(chunk->elems));
+
+    return chunk;
+}
+
+/// \brief Drops one reference to chunk (but not to chunks below)
+static void fstack_release_(Stack_chunk* chunk)
+{
+    assert(chunk && chunk->refs);
+
+    if(--chunk->refs)
+        return;
+
+#ifdef PROTECT
+    memset((void*) chunk, BYTE_POISON, sizeof(Stack_chunk));
+#endif
+
+    free(chunk);
+}
+
+static void fstack_set_guards_(Fork_stack* stk)
+{
+    assert(stk);
+
+#ifdef CANARY
+    stk->beg_can = DEFAULT_CANARY;
+    stk->end_can = DEFAULT_CANARY;
+#endif
+#ifdef STACK_HASH
+    stk->stk_hash = fstack_hash_(stk);
+#endif
+}
+
+static void fstack_set_chunk_guards_(Stack_chunk* chunk)
+{
+    assert(chunk);
+
+#ifdef CANARY
+    chunk->beg_can = DEFAULT_CANARY;
+    chunk->end_can = DEFAULT_CANARY;
+#endif
+#ifdef BUFFER_HASH
+    chunk->hash = qhashfnv1_64(chunk->elems, sizeof(chunk->elems));
+#endif
+}
+
+////////////////////////////////////////////////////////////////
+#ifdef DUMP
+static void fstack_dump_lvl_(const Fork_stack* const stk, Stack_err err, Stack_dump_lvl level, const char msg[],
+                             const char func[], const char file[], int line)
+{
+    FILE* stream = dump_begin_(stk, "Fork_stack", err, level, msg, func, file, line);
+    if(!stream)
+        return;
+
+    if(!stk)
+    {
+        fprintf(stream, "    nullptr to stack\n");
+        fflush(stream);
+        return;
+    }
+
+    fprintf(stream, "    top[%p]\n", TOP_);
+    fprintf(stream, "    size          = %llu\n", SZ_);
+    fprintf(stream, "    top size      = %llu\n", TOP_SZ_);
+
+#ifdef CANARY
+    fprintf(stream, "     stack  begin = %llx\n", stk->beg_can);
+    fprintf(stream, "     stack  end   = %llx\n", stk->end_can);
+#endif
+#ifdef STACK_HASH
+    fprintf(stream, "     stack  hash  = %llx\n", stk->stk_hash);
+#endif
+
+    if(TOP_ == CHUNK_POISON || TOP_SZ_ > FSTACK_CHUNK_CAP)
+    {
+        fflush(stream);
+        return;
+    }
+
+    // Top elements with chunks they are kept in, walk stops at first corrupted chunk
+    fprintf(stream, "    {\n");
+
+    size_t shown    = 0;
+    size_t chunk_sz = TOP_SZ_;
+    for(const Stack_chunk* chunk = TOP_; chunk && shown < DUMP_TAIL_ELEMS; chunk = chunk->prev)
+    {
+        Stack_err chunk_err = fstack_check_chunk_(chunk);
+
+        fprintf(stream, "     chunk[%p] refs = %llu %s\n", chunk, chunk->refs,
+                chunk_err ? "<span class = \"error\">CORRUPTED</span>" : "ok");
+
+        if(chunk_err)
+            break;
+
+        for(size_t slot = chunk_sz; slot > 0 && shown < DUMP_TAIL_ELEMS && shown < SZ_; slot--, shown++)
+        {
+            fprintf(stream, "      #%llu: ", SZ_ - 1 - shown);
+            dump_elem_(stream, &chunk->elems[slot - 1]);
+            fprintf(stream, "\n");
+        }
+
+        chunk_sz = FSTACK_CHUNK_CAP;
+    }
+
+    if(shown < SZ_)
+        fprintf(stream, "        ...  %llu elements below\n", SZ_ - shown);
+
+    fprintf(stream, "    }\n");
+    fflush(stream);
+}
+
+Stack_err fstack_dump_(const Fork_stack* const stk, const char msg[],
+                       const char func[], const char file[], int line)
+{
+    assert(stk && msg && func && file && line);
+
+    Stack_err err = fstack_verify_(stk);
+
+    fstack_dump_lvl_(stk, err, Stack_dump_lvl::DETAILED, msg, func, file, line);
+
+    return err;
+}
+#endif // DUMP
@@ -0,0 +1,479 @@
+#include "include/config.h"
+#include "include/Stack.h"
+#include "include/frame_stack.h"
+#include "include/stack_hash.h"
+
+#ifndef __USE_MINGW_ANSI_STDIO
+#define __USE_MINGW_ANSI_STDIO 1
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+
+static size_t frame_round_(size_t len);
+static int frame_resize_(Frame_stack* stk, size_t new_capacity);
+static void frame_set_guards_(Frame_stack* stk);
+
+#ifdef DUMP
+static void frame_dump_lvl_(const Frame_stack* const stk, Stack_err err, Stack_dump_lvl level, const char msg[],
+                            const char func[], const char file[], int line);
+
+    #ifdef DUMP_ALL
+        #define DO_DUMP frame_dump_lvl_(stk, (Stack_err) err, Stack_dump_lvl::BRIEF, __func__, func, file, line)
+    #else
+        #define DO_DUMP frame_dump_lvl_(stk, (Stack_err) err, Stack_dump_lvl::ONLYERR, __func__, func, file, line)
+    #endif // DUMP_ALL
+#else
+    #define DO_DUMP
+#endif // DUMP
+
+#define ASSERT(condition, error)        \
+    do                                  \
+    {                                   \
+        if(STACK_UNLIKELY(!(condition)))\
+        {                               \
+            err |= error;               \
+            DO_DUMP;                    \
+            return (Stack_err) err;     \
+        }                               \
+    } while(0)                          \
+
+#define BUF_ (stk->buffer)
+#define SZ_ (stk->size)
+#define CAP_ (stk->capacity)
+#define FRAMES_ (stk->frames)
+
+/// \brief Size of footer with padding
+const size_t FRAME_FOOT_SZ = (sizeof(Frame_foot) + FRAME_ALIGN - 1) / FRAME_ALIGN * FRAME_ALIGN;
+
+/// \brief Footer of frame ending at offset end
+#define FOOT_(end) ((Frame_foot*) (BUF_ + (end) - FRAME_FOOT_SZ))
+
+////////////////////////////////////////////////////////////////
+#ifdef PROTECT
+static unsigned char* const FRAME_POISON = (unsigned char*) 0x000000000BAD;
+
+static guard_t frame_hash_(const Frame_stack* stk)
+{
+    assert(stk);
+
+    return qhashfnv1_64(&stk->buffer, (const char*) (&stk->frames + 1) - (const char*) &stk->buffer);
+}
+
+/** \brief Checks frame ending at offset end
+ *
+ *  \param beg [out] Offset of frame beginning
+ */
+static Stack_err frame_check_(const Frame_stack* stk, size_t end, size_t* beg)
+{
+    assert(stk && beg);
+
+    if(end < FRAME_FOOT_SZ || end % FRAME_ALIGN)
+        return Stack_err::BAD_BUF;
+
+    const Frame_foot* foot = FOOT_(end);
+
+    // Canary is the first field of footer, so it is hit first by overflow of frame
+#ifdef CANARY
+    if(foot->can != DEFAULT_CANARY)
+        return Stack_err::BAD_BUF_CAN;
+#endif
+
+    if(foot->len > end - FRAME_FOOT_SZ || frame_round_(foot->len) > end - FRAME_FOOT_SZ)
+        return Stack_err::BAD_BUF;
+
+    *beg = end - FRAME_FOOT_SZ - frame_round_(foot->len);
+
+#ifdef BUFFER_HASH
+    if(foot->hash != qhashfnv1_64(BUF_ + *beg, foot->len))
+        return Stack_err::BAD_BUF_HSH;
+#endif
+
+    return Stack_err::NOERR;
+}
+
+/// \brief Checks fields of stack (without frames)
+static Stack_err frame_check_head_(const Frame_stack* const stk)
+{
+    int err = Stack_err::NOERR;
+
+    if(!stk)
+        return Stack_err::NULLPTR;
+
+    if(BUF_ == FRAME_POISON)
+        return Stack_err::DSTRCTED;
+
+    if(SZ_ > CAP_)
+        return Stack_err::SZ_OVR_CAP;
+
+    if(!BUF_ && (SZ_ || CAP_))
+        return Stack_err::BAD_BUF;
+
+#ifdef CANARY
+    if(stk->beg_can != DEFAULT_CANARY || stk->end_can != DEFAULT_CANARY)
+        err |= Stack_err::BAD_STK_CAN;
+#endif
+#ifdef STACK_HASH
+    if(stk->stk_hash != frame_hash_(stk))
+        err |= Stack_err::BAD_STK_HSH;
+#endif
+
+    return (Stack_err) err;
+}
+
+Stack_err frame_check_top_(const Frame_stack* const stk)
+{
+    int err = frame_check_head_(stk);
+
+    if(!err && SZ_)
+    {
+        size_t beg = 0;
+        err |= frame_check_(stk, SZ_, &beg);
+    }
+
+    if(!err && !SZ_ != !FRAMES_)
+        err |= Stack_err::BAD_BUF;
+
+    return (Stack_err) err;
+}
+
+Stack_err frame_verify_(const Frame_stack* const stk)
+{
+    int err = frame_check_head_(stk);
+
+    // Frames are walked from top by their footers
+    size_t end    = SZ_;
+    size_t frames = 0;
+    while(end && !err)
+    {
+        err |= frame_check_(stk, end, &end);
+        frames++;
+    }
+
+    if(!err && frames != FRAMES_)
+        err |= Stack_err::BAD_BUF;
+
+    return (Stack_err) err;
+}
+#endif // PROTECT ////////////////////////////////////////////////
+
+Stack_err frame_init_(Frame_stack* stk
+              DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
+    ASSERT(stk, Stack_err::NULLPTR);
+
+    ASSERT(BUF_ != FRAME_POISON, Stack_err::DSTRCTED);
+
+    ASSERT(!BUF_, Stack_err::REINIT);
+#endif // PROTECT
+
+    BUF_    = nullptr;
+    SZ_     = 0;
+    CAP_    = 0;
+    FRAMES_ = 0;
+
+    frame_set_guards_(stk);
+
+#ifdef PROTECT
+    err |= frame_verify_(stk);
+    DO_DUMP;
+#endif // PROTECT
+
+    return (Stack_err) err;
+}
+
+Stack_err frame_push_(Frame_stack* stk, const void* data, size_t len
+              DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
+    err = frame_check_top_(stk);
+    ASSERT(!err, err);
+#endif // PROTECT
+
+    ASSERT(data || !len, Stack_err::NULLPTR);
+
+    size_t data_sz  = frame_round_(len);
+    size_t frame_sz = data_sz + FRAME_FOOT_SZ;
+
+    ASSERT(len <= data_sz && data_sz < frame_sz, Stack_err::BAD_ALLOC);
+
+    // Frame may be copied from view of the same stack, its buffer is moved by resize
+    uintptr_t addr   = (uintptr_t) data;
+    bool      inside = BUF_ && addr >= (uintptr_t) BUF_ && addr < (uintptr_t) (BUF_ + SZ_);
+    size_t    offset = inside ? addr - (uintptr_t) BUF_ : 0;
+
+    if(STACK_UNLIKELY(CAP_ - SZ_ < frame_sz))
+    {
+        size_t capacity = CAP_ ? CAP_ : FRAME_MIN_CAP;
+        while(capacity - SZ_ < frame_sz)
+        {
+            ASSERT(capacity <= SIZE_MAX / STACK_CAP_MULTPLR, Stack_err::BAD_ALLOC);
+            capacity *= STACK_CAP_MULTPLR;
+        }
+
+        ASSERT(frame_resize_(stk, capacity) == 0, Stack_err::BAD_ALLOC);
+
+        if(inside)
+            data = BUF_ + offset;
+    }
+
+    unsigned char* frame = BUF_ + SZ_;
+
+    if(len)
+        memcpy(frame, data, len);
+
+#ifdef PROTECT
+    memset(frame + len, BYTE_POISON, frame_sz - len);
+#endif
+
+    Frame_foot* foot = (Frame_foot*) (frame + data_sz);
+    *foot = {};
+
+    foot->len = len;
+#ifdef BUFFER_HASH
+    foot->hash = qhashfnv1_64(frame, len);
+#endif
+#ifdef CANARY
+    foot->can = DEFAULT_CANARY;
+#endif
+
+    SZ_ += frame_sz;
+    FRAMES_++;
+
+    frame_set_guards_(stk);
+
+#ifdef PROTECT
+    err = frame_check_top_(stk);
+    DO_DUMP;
+#endif // PROTECT
+
+    return (Stack_err) err;
+}
+
+Stack_err frame_pop_(Frame_stack* stk
+             DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
+    err = frame_check_top_(stk);
+    ASSERT(!err, err);
+#endif // PROTECT
+
+    ASSERT(FRAMES_, Stack_err::POP_EMPT_STK);
+
+    size_t frame_sz = frame_round_(FOOT_(SZ_)->len) + FRAME_FOOT_SZ;
+
+    SZ_ -= frame_sz;
+    FRAMES_--;
+
+#ifdef PROTECT
+    memset(BUF_ + SZ_, BYTE_POISON, frame_sz);
+#endif
+
+    if(STACK_UNLIKELY(SZ_ * STACK_CAP_MULTPLR * STACK_CAP_MULTPLR <= CAP_) && CAP_ > FRAME_MIN_CAP)
+        ASSERT(frame_resize_(stk, CAP_ / STACK_CAP_MULTPLR) == 0, Stack_err::BAD_ALLOC);
+
+    frame_set_guards_(stk);
+
+#ifdef PROTECT
+    err = frame_check_top_(stk);
+    DO_DUMP;
+#endif // PROTECT
+
+    return (Stack_err) err;
+}
+
+Stack_err frame_top_(const Frame_stack* stk, Frame_view* view
+             DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
+    err = frame_check_top_(stk);
+    ASSERT(!err, err);
+
+    ASSERT(view, Stack_err::NULLPTR);
+#endif // PROTECT
+
+    ASSERT(FRAMES_, Stack_err::EMPT_STK);
+
+    size_t len = FOOT_(SZ_)->len;
+
+    view->data = BUF_ + SZ_ - FRAME_FOOT_SZ - frame_round_(len);
+    view->len  = len;
+
+    return Stack_err::NOERR;
+}
+
+Stack_err frame_dstr_(Frame_stack* stk
+              DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
+    err = frame_verify_(stk);
+
+    ASSERT(stk, Stack_err::NULLPTR);
+
+    ASSERT(BUF_ != FRAME_POISON, Stack_err::DSTRCTED);
+
+    if(BUF_)
+        memset(BUF_, BYTE_POISON, CAP_);
+#endif // PROTECT
+
+    free(BUF_);
+
+#ifdef PROTECT
+    BUF_    = FRAME_POISON;
+    SZ_     = SIZE_POISON;
+    CAP_    = SIZE_POISON;
+    FRAMES_ = SIZE_POISON;
+
+#ifdef STACK_HASH
+    stk->stk_hash = SIZE_POISON;
+#endif
+#ifdef CANARY
+    stk->beg_can = (guard_t) SIZE_POISON;
+    stk->end_can = (guard_t) SIZE_POISON;
+#endif
+
+    DO_DUMP;
+#else
+    BUF_    = nullptr;
+    SZ_     = 0;
+    CAP_    = 0;
+    FRAMES_ = 0;
+#endif // PROTECT
+
+    return (Stack_err) err;
+}
+
+/// \brief Length of frame with padding
+static size_t frame_round_(size_t len)
+{
+    return (len + FRAME_ALIGN - 1) / FRAME_ALIGN * FRAME_ALIGN;
+}
+
+static int frame_resize_(Frame_stack* stk, size_t new_capacity)
+{
+    assert(stk && new_capacity >= SZ_);
+
+    // malloc aligns to max_align_t, so frames stay aligned to FRAME_ALIGN
+    unsigned char* buffer = (unsigned char*) realloc(BUF_, new_capacity);
+    if(!buffer)
+        return -1;
+
+#ifdef PROTECT
+    if(new_capacity > CAP_)
+        memset(buffer + CAP_, BYTE_POISON, new_capacity - CAP_);
+#endif
+
+    BUF_ = buffer;
+    CAP_ = new_capacity;
+
+    return 0;
+}
+
+static void frame_set_guards_(Frame_stack* stk)
+{
+    assert(stk);
+
+#ifdef CANARY
+    stk->beg_can = DEFAULT_CANARY;
+    stk->end_can = DEFAULT_CANARY;
+#endif
+#ifdef STACK_HASH
+    stk->stk_hash = frame_hash_(stk);
+#endif
+}
+
+////////////////////////////////////////////////////////////////
+#ifdef DUMP
+static void frame_dump_lvl_(const Frame_stack* const stk, Stack_err err, Stack_dump_lvl level, const char msg[],
+                            const char func[], const char file[], int line)
+{
+    FILE* stream = dump_begin_(stk, "Frame_stack", err, level, msg, func, file, line);
+    if(!stream)
+        return;
+
+    if(!stk)
+    {
+        fprintf(stream, "    nullptr to stack\n");
+        fflush(stream);
+        return;
+    }
+
+    fprintf(stream, "    buffer[%p]\n", BUF_);
+    fprintf(stream, "    size          = %llu\n", SZ_);
+    fprintf(stream, "    capacity      = %llu\n", CAP_);
+    fprintf(stream, "    frames        = %llu\n", FRAMES_);
+
+#ifdef CANARY
+    fprintf(stream, "     stack  begin = %llx\n", stk->beg_can);
+    fprintf(stream, "     stack  end   = %llx\n", stk->end_can);
+#endif
+#ifdef STACK_HASH
+    fprintf(stream, "     stack  hash  = %llx\n", stk->stk_hash);
+#endif
+
+    if(BUF_ == FRAME_POISON || !BUF_ || SZ_ > CAP_)
+    {
+        fflush(stream);
+        return;
+    }
+
+    fprintf(stream, "    {\n");
+
+    // Frames from the top, walk stops at first corrupted frame
+    const size_t PREVIEW_SZ = 16;
+
+    size_t end    = SZ_;
+    size_t nframe = 0;
+    while(end && nframe < DUMP_TAIL_ELEMS)
+    {
+        size_t beg = 0;
+        Stack_err frame_err = frame_check_(stk, end, &beg);
+
+        if(frame_err)
+        {
+            fprintf(stream, "     frame ending at [%llu] <span class = \"error\">CORRUPTED</span>\n", end);
+            break;
+        }
+
+        size_t len = FOOT_(end)->len;
+
+        fprintf(stream, "     #%llu [%llu] len = %llu ok  ", FRAMES_ - 1 - nframe, beg, len);
+        for(size_t i = 0; i < len && i < PREVIEW_SZ; i++)
+            fprintf(stream, "%02x ", BUF_[beg + i]);
+        fprintf(stream, "%s\n", len > PREVIEW_SZ ? "..." : "");
+
+        end = beg;
+        nframe++;
+    }
+
+    if(end && nframe == DUMP_TAIL_ELEMS)
+        fprintf(stream, "     ... %llu frames below\n", FRAMES_ - nframe);
+
+    fprintf(stream, "    }\n");
+    fflush(stream);
+}
+
+Stack_err frame_dump_(const Frame_stack* const stk, const char msg[],
+                      const char func[], const char file[], int line)
+{
+    assert(stk && msg && func && file && line);
+
+    Stack_err err = frame_verify_(stk);
+
+    frame_dump_lvl_(stk, err, Stack_dump_lvl::DETAILED, msg, func, file, line);
+
+    return err;
+}
+#endif // DUMP
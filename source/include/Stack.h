@@ -22,19 +22,71 @@ enum Stack_err
     CAP_OVR_SZ      = 1 << 10, /// capacity is too large for current size
     POP_EMPT_STK    = 1 << 11, /// pop from empty stack (WARNING: is not shown in dump)
     NULLPTR         = 1 << 12, /// nullptr was passed
+    BAD_TYPE        = 1 << 13, /// type of top element mismatches requested one (tagged values)
+    EMPT_STK        = 1 << 14, /// query of empty stack
+    STK_FULL        = 1 << 15, /// push to full stack of fixed capacity
+    BAD_ARG         = 1 << 16, /// argument is out of range
+    STK_BUSY        = 1 << 17, /// stack was changed during every try of snapshot
 };
 
+#ifdef __GNUC__
+    #define STACK_LIKELY(cond)   __builtin_expect(!!(cond), 1)
+    #define STACK_UNLIKELY(cond) __builtin_expect(!!(cond), 0)
+    /// \brief Marks rarely called function (kept out of line)
+    #define STACK_COLD           __attribute__((cold, noinline))
+#else
+    #define STACK_LIKELY(cond)   (cond)
+    #define STACK_UNLIKELY(cond) (cond)
+    #define STACK_COLD
+#endif
+
 #include <stdint.h>
+#include <string.h>
 #include "config.h"
 #include "dump.h"
+#include "stack_alloc.h"
 
 /// \brief Capacity multiplier for reallocating
 const size_t STACK_CAP_MULTPLR  = 2;
 /// \brief Minimal capacity 
 const size_t STACK_MIN_CAP      = 4 * STACK_CAP_MULTPLR;
 
+#ifdef STACK_FIXED_CAP
+static_assert(STACK_FIXED_CAP >= STACK_MIN_CAP, "STACK_FIXED_CAP is less than STACK_MIN_CAP");
+#endif
+
 const unsigned char BYTE_POISON = 0xBD;
 
+#if !defined(POISON_LAZY) && !defined(POISON_ASAN)
+    /// \brief Free slots of buffer are filled with BYTE_POISON
+    #define POISON_EAGER
+#endif
+
+#ifdef POISON_ASAN
+    #include <sanitizer/asan_interface.h>
+#endif
+
+/** \brief Lanes of stack buffer
+ *
+ *  Buffer of capacity CAP consists of STACK_LANES arrays of CAP elements.
+ *  Element lane is followed by enabled aggregate lanes, slot i of aggregate lane
+ *  keeps aggregate of elements [0, i].
+ */
+enum Stack_lane
+{
+    ELEM_LANE = 0,
+#ifdef AGGR_MIN
+    MIN_LANE,
+#endif
+#ifdef AGGR_MAX
+    MAX_LANE,
+#endif
+#ifdef AGGR_SUM
+    SUM_LANE,
+#endif
+    STACK_LANES,
+};
+
 #ifdef PROTECT
 typedef uint64_t guard_t;
 const size_t SIZE_POISON       = 0x1BADBADBADBADBAD;
@@ -45,13 +97,60 @@ const Elem_t* const BUF_POISON = (Elem_t*) 0x000000000BAD;
 const guard_t DEFAULT_CANARY   = 0xBAC1CAB1DED1BED1;
 #endif
 
-struct Stack
+/// \brief Size of cache line
+const size_t STACK_LINE_SZ     = 64;
+
+/// \brief Cold part of stack (placement options and debug info) used only on init, resize and dump
+struct Stack_info
+{
+                Stack_alloc alloc     = {};
+
+#ifdef DUMP
+                const char* init_func = nullptr;
+                const char* init_file = nullptr;
+                int init_line         = 0;
+#endif
+#ifdef TRACE
+                uint64_t trace_id     = 0;
+#endif
+};
+
+/// \brief Number of tries of stack_snapshot before Stack_err::STK_BUSY is returned
+const int STACK_SNAPSHOT_TRIES = 256;
+
+/// \brief Read-only view of stack elements (valid until next push or pop)
+struct Stack_span
+{
+                const Elem_t* data    = nullptr; ///< data[0] is bottom element
+                size_t size           = 0;
+};
+
+/// \brief Consistent state of stack taken by stack_snapshot
+struct Stack_snapshot
+{
+                size_t size           = 0;
+                size_t capacity       = 0;
+                size_t count          = 0; ///< number of copied top elements
+                uint64_t seq          = 0; ///< version of stack snapshot was taken at
+};
+
+/** \brief Stack structure
+ *
+ *  Fields used by push and pop (with protection) fit in one cache line,
+ *  cold ones are moved to Stack_info allocated on init. Stack hash covers hash
+ *  of Stack_info kept here, so push and pop do not read the cold record.
+ *  With SNAPSHOT version of stack takes place of info in the first line, info and
+ *  fields changed by snapshot readers are moved to the second line.
+ */
+struct alignas(STACK_LINE_SZ) Stack
 {
 #ifdef CANARY
                 guard_t beg_can       = 0;
 #endif
 #ifdef STACK_HASH
-                guard_t stk_hash      = 0;
+                // Both hashes share one guard, so all guards fit in the line
+                uint32_t stk_hash     = 0; ///< hash of fields from info_hash to capacity (and info without SNAPSHOT)
+                uint32_t info_hash    = 0; ///< hash of info and record it points to (changed only with them)
 #endif
 
                 Elem_t* buffer        = nullptr;
@@ -59,19 +158,37 @@ struct Stack
                 size_t size           = 0;
                 size_t capacity       = 0;
 
-#ifdef DUMP
-                const char* init_func = nullptr;
-                const char* init_file = 0;
-                int init_line         = 0;
-#endif 
+#ifdef SNAPSHOT
+                uint64_t seq          = 0; ///< version of stack, odd while stack is changed (not hashed)
+#else
+                Stack_info* info      = nullptr;
+#endif
+
 #ifdef BUFFER_HASH
                 guard_t buf_hash      = 0;
 #endif
 #ifdef CANARY
                 guard_t end_can       = 0;
 #endif
+
+#ifdef SNAPSHOT
+                // Readers change this line, owner reads it only on init, resize and dump
+                alignas(STACK_LINE_SZ)
+                Stack_info* info      = nullptr;
+#ifdef STACK_HASH
+                uint32_t info_ptr_hash = 0;      ///< hash of info (stack hash does not cover it with SNAPSHOT)
+#endif
+                int readers           = 0;       ///< number of snapshots in progress (not hashed)
+                void* retired         = nullptr; ///< old buffers which snapshots may still read (not hashed)
+#endif
 };
 
+#ifdef SNAPSHOT
+static_assert(sizeof(Stack) == 2 * STACK_LINE_SZ, "Fields of owner do not fit in one cache line");
+#else
+static_assert(sizeof(Stack) == STACK_LINE_SZ, "Stack does not fit in one cache line");
+#endif
+
 //////////////////////////////////////////////////////////////////////////////
 /** \brief Verifies and dumps stack to logfile
  * 
@@ -94,7 +211,20 @@ struct Stack
  *  \warning Memory for stack structure should be free
  */
 #define stack_init(stk, size)                                                \
-        stack_init_((stk), (size)                                            \
+        stack_init_((stk), (size), nullptr                                   \
+                         DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))   \
+
+/** \brief Initializes stack with buffer placement options
+ * 
+ *  \param stk   [in][out] Pointer to stack
+ *  \param size  [in]      Initial size for stack (if 0 stack buffer is not allocated)
+ *  \param alloc [in]      Pointer to Stack_alloc with NUMA node and huge pages options
+ * 
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ *  \warning Memory for stack structure should be free
+ */
+#define stack_init_alloc(stk, size, alloc)                                   \
+        stack_init_((stk), (size), (alloc)                                   \
                          DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))   \
 
 /** \brief Pushes element to stack
@@ -105,7 +235,7 @@ struct Stack
  *  \return Stack_err::NOERR if succeed and error number otherwise
  */
 #define stack_push(stk, elem)                                                \
-        stack_push_((stk), (elem)                                            \
+        stack_push_fast_((stk), (elem)                                       \
                          DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))   \
 
 /** \brief Pops element from stack
@@ -119,7 +249,44 @@ struct Stack
  *  \warning Nullptr as second argument results in Stack_err::NULLPTR and error message in dump
  */
 #define stack_pop(stk, elem)                                                 \
-        stack_pop_((stk), (elem)                                             \
+        stack_pop_fast_((stk), (elem)                                        \
+                        DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))    \
+
+/** \brief Gets top element of stack without popping it
+ * 
+ *  \param stk  [in]  Pointer to stack
+ *  \param elem [out] Pointer to variable to write top element
+ * 
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ *  \warning Query of empty stack returns Stack_err::EMPT_STK
+ */
+#define stack_top(stk, elem)                                                 \
+        stack_top_fast_((stk), (elem)                                        \
+                        DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))    \
+
+/** \brief Gets element at depth from top of stack without popping it
+ * 
+ *  \param stk   [in]  Pointer to stack
+ *  \param depth [in]  Depth of element (0 for top element)
+ *  \param elem  [out] Pointer to variable to write element
+ * 
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ *  \warning Query of empty stack returns Stack_err::EMPT_STK, depth not less than size returns Stack_err::BAD_ARG
+ */
+#define stack_peek(stk, depth, elem)                                         \
+        stack_peek_fast_((stk), (depth), (elem)                              \
+                        DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))    \
+
+/** \brief Gets read-only view of all stack elements without copying them
+ * 
+ *  \param stk  [in]  Pointer to stack
+ *  \param span [out] Pointer to view of elements (from bottom to top)
+ * 
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ *  \warning View is invalidated by next push or pop
+ */
+#define stack_span(stk, span)                                                \
+        stack_span_((stk), (span)                                            \
                         DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))    \
 
 /** \brief Destroys stack
@@ -133,6 +300,27 @@ struct Stack
         stack_dstr_((stk)                                                    \
                  DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))           \
 
+/** \brief Gets aggregate of stack elements in O(1)
+ *
+ *  \param stk [in]  Pointer to stack
+ *  \param val [out] Pointer to variable to write aggregate
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ *  \warning Query of empty stack returns Stack_err::EMPT_STK
+ *  \warning Available only if corresponding AGGR_MIN, AGGR_MAX or AGGR_SUM is defined
+ */
+#define stack_min(stk, val)                                                  \
+        stack_aggr_((stk), MIN_LANE, (val)                                   \
+                        DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))    \
+
+#define stack_max(stk, val)                                                  \
+        stack_aggr_((stk), MAX_LANE, (val)                                   \
+                        DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))    \
+
+#define stack_sum(stk, val)                                                  \
+        stack_aggr_((stk), SUM_LANE, (val)                                   \
+                        DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))    \
+
 //////////////////////////////////////////////////////////////////////////////
 
 #ifdef DUMP
@@ -143,7 +331,17 @@ struct Stack
 
 Stack_err stack_verify_(const Stack* const stk);
 
-Stack_err stack_init_(Stack* stk, ssize_t preset_cap
+/** \brief Cheap verification for read-only queries: bounds, canaries and stack hash in O(1)
+ *         (buffer hash is not recomputed, it is checked by functions changing stack)
+ */
+Stack_err stack_check_(const Stack* const stk);
+
+/** \brief Verification of Stack_info against its hash kept in stack (on init, resize, dump and destruction)
+ *         (pointer to record is verified before record is read)
+ */
+Stack_err stack_check_info_(const Stack* const stk);
+
+Stack_err stack_init_(Stack* stk, ssize_t preset_cap, const Stack_alloc* alloc
               DUMP_ON(const char func[], const char file[], int line));
 
 Stack_err stack_push_(Stack* stk, Elem_t elem
@@ -152,7 +350,193 @@ Stack_err stack_push_(Stack* stk, Elem_t elem
 Stack_err stack_pop_ (Stack* stk, Elem_t* elem
               DUMP_ON(const char func[], const char file[], int line));
 
+/** \brief Pop of stack already verified by caller (stack is verified only after pop)
+ */
+Stack_err stack_pop_unchecked_(Stack* stk, Elem_t* elem
+              DUMP_ON(const char func[], const char file[], int line));
+
 Stack_err stack_dstr_(Stack* stk
               DUMP_ON(const char func[], const char file[], int line));
 
+Stack_err stack_top_ (const Stack* stk, Elem_t* elem
+              DUMP_ON(const char func[], const char file[], int line));
+
+Stack_err stack_peek_(const Stack* stk, size_t depth, Elem_t* elem
+              DUMP_ON(const char func[], const char file[], int line));
+
+Stack_err stack_span_(const Stack* stk, Stack_span* span
+              DUMP_ON(const char func[], const char file[], int line));
+
+Stack_err stack_aggr_(const Stack* stk, Stack_lane lane, Elem_t* val
+              DUMP_ON(const char func[], const char file[], int line));
+
+#ifdef SNAPSHOT
+/** \brief Takes consistent snapshot of stack changed by another thread (seqlock read, owner is never blocked)
+ *
+ *  \param stk   [in]  Pointer to stack
+ *  \param snap  [out] Pointer to snapshot of size and capacity
+ *  \param elems [out] Array to write top elements to (elems[0] is top element)
+ *  \param k     [in]  Maximal number of top elements to copy
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ *  \warning Torn snapshot is retried, Stack_err::STK_BUSY is returned after STACK_SNAPSHOT_TRIES tries
+ *  \warning Snapshot is not verified and not dumped (use it instead of stack_dump from other threads),
+ *           stack should not be initialized or destroyed during snapshot
+ */
+Stack_err stack_snapshot(const Stack* stk, Stack_snapshot* snap, Elem_t elems[], size_t k);
+#endif // SNAPSHOT
+
+//////////////////////////////////////////////////////////////////////////////
+// Fast path: without protection push, pop and top with enough capacity are
+// performed inline, everything else (resize, errors, dump) goes to stack_*_ functions
+// (push and pop are not inlined with TRACE, so every operation is recorded)
+
+/// \brief Makes version of stack odd before changing it (snapshots taken meanwhile are retried)
+/// \return  odd version, it is passed to stack_write_end_ (version is not loaded again)
+inline uint64_t stack_write_begin_(Stack* stk)
+{
+#ifdef SNAPSHOT
+    uint64_t seq = stk->seq + 1;
+
+    __atomic_store_n(&stk->seq, seq, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    return seq;
+#else
+    (void) stk;
+
+    return 0;
+#endif // SNAPSHOT
+}
+
+/// \brief Makes version of stack even after changing it
+inline void stack_write_end_(Stack* stk, uint64_t seq)
+{
+#ifdef SNAPSHOT
+    __atomic_store_n(&stk->seq, seq + 1, __ATOMIC_RELEASE);
+#else
+    (void) stk;
+    (void) seq;
+#endif // SNAPSHOT
+}
+
+/// \brief Prepares slot of every lane for push (with POISON_ASAN slot is unpoisoned)
+inline void stack_slot_use_(Stack* stk, size_t slot)
+{
+#ifdef POISON_ASAN
+    for(size_t lane = 0; lane < STACK_LANES; lane++)
+        ASAN_UNPOISON_MEMORY_REGION(stk->buffer + lane * stk->capacity + slot, sizeof(Elem_t));
+#else
+    (void) stk;
+    (void) slot;
+#endif // POISON_ASAN
+}
+
+/// \brief Frees slot of every lane after pop (filled with BYTE_POISON with protection or poisoned with POISON_ASAN)
+inline void stack_slot_free_(Stack* stk, size_t slot)
+{
+#if defined(POISON_ASAN)
+    for(size_t lane = 0; lane < STACK_LANES; lane++)
+        ASAN_POISON_MEMORY_REGION(stk->buffer + lane * stk->capacity + slot, sizeof(Elem_t));
+#elif defined(POISON_EAGER) && defined(PROTECT)
+    for(size_t lane = 0; lane < STACK_LANES; lane++)
+        memset(stk->buffer + lane * stk->capacity + slot, BYTE_POISON, sizeof(Elem_t));
+#else
+    (void) stk;
+    (void) slot;
+#endif // POISON_ASAN
+}
+
+/// \brief Updates aggregate lanes for element written to slot stk->size
+inline void stack_aggr_push_(Stack* stk)
+{
+#if defined(AGGR_MIN) || defined(AGGR_MAX) || defined(AGGR_SUM)
+    size_t  size = stk->size;
+    Elem_t  elem = stk->buffer[size];
+#else
+    (void) stk;
+#endif
+
+#ifdef AGGR_MIN
+    Elem_t* min = stk->buffer + MIN_LANE * stk->capacity;
+    min[size] = (size && min[size - 1] < elem) ? min[size - 1] : elem;
+#endif
+#ifdef AGGR_MAX
+    Elem_t* max = stk->buffer + MAX_LANE * stk->capacity;
+    max[size] = (size && elem < max[size - 1]) ? max[size - 1] : elem;
+#endif
+#ifdef AGGR_SUM
+    Elem_t* sum = stk->buffer + SUM_LANE * stk->capacity;
+    sum[size] = size ? sum[size - 1] + elem : elem;
+#endif
+}
+
+inline Stack_err stack_push_fast_(Stack* stk, Elem_t elem
+              DUMP_ON(const char func[], const char file[], int line))
+{
+#if !defined(PROTECT) && !defined(TRACE)
+    if(STACK_LIKELY(stk->size < stk->capacity))
+    {
+        uint64_t seq = stack_write_begin_(stk);
+        stack_slot_use_(stk, stk->size);
+        stk->buffer[stk->size] = elem;
+        stack_aggr_push_(stk);
+        stk->size++;
+        stack_write_end_(stk, seq);
+
+        return Stack_err::NOERR;
+    }
+#endif // PROTECT && TRACE
+
+    return stack_push_(stk, elem DUMP_ON(func, file, line));
+}
+
+inline Stack_err stack_pop_fast_(Stack* stk, Elem_t* elem
+              DUMP_ON(const char func[], const char file[], int line))
+{
+#if !defined(PROTECT) && !defined(TRACE)
+    if(STACK_LIKELY(stk->size))
+    {
+        uint64_t seq = stack_write_begin_(stk);
+        *elem = stk->buffer[--stk->size];
+        stack_slot_free_(stk, stk->size);
+        stack_write_end_(stk, seq);
+
+        return Stack_err::NOERR;
+    }
+#endif // PROTECT && TRACE
+
+    return stack_pop_(stk, elem DUMP_ON(func, file, line));
+}
+
+inline Stack_err stack_top_fast_(const Stack* stk, Elem_t* elem
+              DUMP_ON(const char func[], const char file[], int line))
+{
+#ifndef PROTECT
+    if(STACK_LIKELY(stk->size))
+    {
+        *elem = stk->buffer[stk->size - 1];
+
+        return Stack_err::NOERR;
+    }
+#endif // PROTECT
+
+    return stack_top_(stk, elem DUMP_ON(func, file, line));
+}
+
+inline Stack_err stack_peek_fast_(const Stack* stk, size_t depth, Elem_t* elem
+              DUMP_ON(const char func[], const char file[], int line))
+{
+#ifndef PROTECT
+    if(STACK_LIKELY(depth < stk->size))
+    {
+        *elem = stk->buffer[stk->size - 1 - depth];
+
+        return Stack_err::NOERR;
+    }
+#endif // PROTECT
+
+    return stack_peek_(stk, depth, elem DUMP_ON(func, file, line));
+}
+
 #endif // STACK_H
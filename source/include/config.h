@@ -3,6 +3,7 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 
 #ifndef CONFIG_H
 #define CONFIG_H
@@ -12,6 +13,39 @@
                 /// Path to file for logs (can be replaced using stack_dump_set_stream)
                 const char STACK_DUMPFILE[] = "log.html";
 
+                /// \brief Keep minimum of stack elements for stack_min (uncomment to turn on)
+                // #define AGGR_MIN
+
+                /// \brief Keep maximum of stack elements for stack_max (uncomment to turn on)
+                // #define AGGR_MAX
+
+                /// \brief Keep sum of stack elements for stack_sum (uncomment to turn on)
+                // #define AGGR_SUM
+
+                /// \brief Make capacity of all stacks fixed and equal to this value, not less than STACK_MIN_CAP (uncomment to turn on)
+                // #define STACK_FIXED_CAP 1024
+
+                /// \brief Don't fill free slots of buffer with BYTE_POISON, only slots below size are read (uncomment to turn on)
+                // #define POISON_LAZY
+
+                /// \brief Poison free slots of buffer for AddressSanitizer instead of filling them (uncomment to turn on)
+                // #define POISON_ASAN
+
+#if defined(POISON_LAZY) && defined(POISON_ASAN)
+#error "Turn on only one of POISON_LAZY and POISON_ASAN"
+#endif
+
+                /// \brief Record init, push, pop and destruction of stacks to STACK_TRACEFILE (uncomment to turn on)
+                // #define TRACE
+
+                /// \brief Allow consistent snapshots of stacks from other threads with stack_snapshot (uncomment to turn on)
+                // #define SNAPSHOT
+
+#ifdef TRACE
+                /// Path to trace file (can be replaced using stack_trace_init)
+                const char STACK_TRACEFILE[] = "stack.trace";
+#endif
+
                 /// \brief Turn on protection for stack
                 #define PROTECT
 
@@ -25,6 +59,12 @@
 #ifdef DUMP
                 /// \brief Turn on all dumps (Does not work without PROTECT and DUMP defines)
                 #define DUMP_ALL
+
+                /// \brief Number of buffer slots printed from the bottom in detailed dump
+                const size_t DUMP_HEAD_ELEMS = 16;
+
+                /// \brief Number of buffer slots printed below and above the top in detailed dump
+                const size_t DUMP_TAIL_ELEMS = 16;
 #endif
 
                 /// \brief Turn on stack hash (Does not work without PROTECT define)
@@ -18,6 +18,23 @@
  */
 void stack_dump_init(FILE* dumpstream, void (*print_func)(FILE*, const Elem_t*));
 
+/** \brief Sets function formatting elements to dump buffer (used instead of print function)
+ *
+ *  \param format_func Function writing Elem_t to dst (at most dst_sz bytes) and returning number of written bytes
+ *                     (if 0 passed elements are printed with function set by stack_dump_init)
+ */
+void stack_dump_set_format(size_t (*format_func)(char dst[], size_t dst_sz, const Elem_t* elem));
+
+/** \brief Fast formatter for double elements (can be passed to stack_dump_set_format)
+ *
+ *  \param dst    [out] Buffer to write to
+ *  \param dst_sz [in]  Size of buffer
+ *  \param elem   [in]  Element to format
+ *
+ *  \return Number of written bytes
+ */
+size_t stack_format_double(char dst[], size_t dst_sz, const double* elem);
+
 #ifdef DUMP
 const char BAD_ALLOCATION[]    = "Allocation has failed\n";
 const char BAD_BUFFER[]        = "Buffer is corrupted\n";
@@ -32,6 +49,11 @@ const char SIZE_OVER_CAP[]     = "Size is greater than capacity\n";
 const char CAP_OVER_SIZE[]     = "Capacity is greater than needed for current size\n";
 const char POP_EMPTY_STACK[]   = "Trying to pop from empty stack\n";
 const char NULLPOINTER[]       = "Nullptr was passed\n";
+const char TYPE_MISMATCH[]     = "Type of top element mismatches requested one\n";
+const char EMPTY_STACK[]       = "Query of empty stack\n";
+const char STACK_FULL[]        = "Stack of fixed capacity is full\n";
+const char BAD_ARGUMENT[]      = "Argument is out of range\n";
+const char STACK_BUSY[]        = "Stack was changed during every try of snapshot\n";
 
 struct Stack;
 
@@ -43,9 +65,30 @@ enum Stack_dump_lvl
     DETAILED = 2, ///< dumps all information about stack condition
 };
 
+STACK_COLD
 void dump_(const Stack* const stk, Stack_err err, Stack_dump_lvl level, const char msg[],
            const char func[], const char file[], int line);
 
+/** \brief Prints common part of dump (message, address and errors)
+ *
+ *  \param obj  [in] Pointer to dumped structure
+ *  \param name [in] Name of dumped structure
+ *
+ *  \return Dump stream to print details to (if dump is detailed) or nullptr
+ */
+STACK_COLD
+FILE* dump_begin_(const void* obj, const char name[], Stack_err err, Stack_dump_lvl level,
+                  const char msg[], const char func[], const char file[], int line);
+
+/** \brief Prints element with function set by stack_dump_set_format or stack_dump_init
+ *
+ *  \param stream [in] Dump stream returned by dump_begin_
+ *  \param elem   [in] Pointer to element
+ */
+STACK_COLD
+void dump_elem_(FILE* stream, const Elem_t* elem);
+
+STACK_COLD
 Stack_err stack_dump_(const Stack* const stk, const char msg[],
                       const char func[], const char file[], int line);
 
@@ -0,0 +1,145 @@
+/** \file
+ *  \brief Header containing persistent stack with cheap forking
+ *
+ *  Stack is a list of fixed-size chunks linked from top to bottom. Forked stacks
+ *  share chunks (reference counted), shared top chunk is copied on first write.
+ *  So fork is O(1) and memory is proportional to divergent parts only.
+ */
+#ifndef FORK_STACK_H
+#define FORK_STACK_H
+
+#include "Stack.h"
+
+/// \brief Number of elements in one chunk
+const size_t FSTACK_CHUNK_CAP = 256;
+
+/// \brief Chunk of elements shared between forked stacks
+struct Stack_chunk
+{
+#ifdef CANARY
+                guard_t beg_can       = 0;
+#endif
+                Stack_chunk* prev     = nullptr;
+                size_t refs           = 0;
+#ifdef BUFFER_HASH
+                guard_t hash          = 0;
+#endif
+
+                Elem_t elems[FSTACK_CHUNK_CAP];
+
+#ifdef CANARY
+                guard_t end_can       = 0;
+#endif
+};
+
+struct Fork_stack
+{
+#ifdef CANARY
+                guard_t beg_can       = 0;
+#endif
+#ifdef STACK_HASH
+                guard_t stk_hash      = 0;
+#endif
+
+                Stack_chunk* top      = nullptr;
+
+                size_t top_size       = 0;
+                size_t size           = 0;
+
+#ifdef CANARY
+                guard_t end_can       = 0;
+#endif
+};
+
+//////////////////////////////////////////////////////////////////////////////
+/** \brief Verifies and dumps stack (with all its chunks) to logfile
+ *
+ *  \param stk [in] Pointer to stack
+ *  \param msg [in] String message for dump
+ */
+#ifdef DUMP
+#define fstack_dump(stk, msg)                                                \
+        fstack_dump_((stk), (msg), __PRETTY_FUNCTION__, __FILE__, __LINE__)
+#else
+#define fstack_dump(stk, msg)
+#endif // DUMP
+
+/** \brief Initializes empty stack
+ *
+ *  \param stk [in][out] Pointer to stack
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ */
+#define fstack_init(stk)                                                     \
+        fstack_init_((stk)                                                   \
+                         DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))   \
+
+/** \brief Initializes stack as a fork of another one
+ *
+ *  \param dst [in][out] Pointer to stack to be initialized
+ *  \param src [in][out] Pointer to forked stack
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ *  \warning Stacks share all chunks after fork, so it takes O(1)
+ */
+#define fstack_fork(dst, src)                                                \
+        fstack_fork_((dst), (src)                                            \
+                         DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))   \
+
+/** \brief Pushes element to stack
+ *
+ *  \param stk  [in][out] Pointer to stack
+ *  \param elem [in]      Element to be pushed
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ */
+#define fstack_push(stk, elem)                                               \
+        fstack_push_((stk), (elem)                                           \
+                         DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))   \
+
+/** \brief Pops element from stack
+ *
+ *  \param stk  [in][out] Pointer to stack
+ *  \param elem [out]     Pointer to variable to write popped element
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ */
+#define fstack_pop(stk, elem)                                                \
+        fstack_pop_((stk), (elem)                                            \
+                         DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))   \
+
+/** \brief Destroys stack (chunks are freed when no other stack uses them)
+ *
+ *  \param stk [in][out] Pointer to stack
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ */
+#define fstack_dstr(stk)                                                     \
+        fstack_dstr_((stk)                                                   \
+                         DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))   \
+
+//////////////////////////////////////////////////////////////////////////////
+
+Stack_err fstack_verify_(const Fork_stack* const stk);
+
+Stack_err fstack_init_(Fork_stack* stk
+              DUMP_ON(const char func[], const char file[], int line));
+
+Stack_err fstack_fork_(Fork_stack* dst, Fork_stack* src
+              DUMP_ON(const char func[], const char file[], int line));
+
+Stack_err fstack_push_(Fork_stack* stk, Elem_t elem
+              DUMP_ON(const char func[], const char file[], int line));
+
+Stack_err fstack_pop_ (Fork_stack* stk, Elem_t* elem
+              DUMP_ON(const char func[], const char file[], int line));
+
+Stack_err fstack_dstr_(Fork_stack* stk
+              DUMP_ON(const char func[], const char file[], int line));
+
+#ifdef DUMP
+Stack_err fstack_dump_(const Fork_stack* const stk, const char msg[],
+                       const char func[], const char file[], int line);
+#endif // DUMP
+
+#endif // FORK_STACK_H
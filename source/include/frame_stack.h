@@ -0,0 +1,156 @@
+/** \file
+ *  \brief Header containing stack of variable-size frames
+ *
+ *  Frames are kept in one byte buffer, every frame is followed by footer with
+ *  its length (so top frame is found in O(1)), hash and canary. Frames and
+ *  footers are aligned to FRAME_ALIGN.
+ */
+#ifndef FRAME_STACK_H
+#define FRAME_STACK_H
+
+#include <stdint.h>
+#include "Stack.h"
+
+/// \brief Alignment of frames (frame can hold any fundamental type)
+const size_t FRAME_ALIGN   = alignof(max_align_t);
+/// \brief Minimal capacity of buffer in bytes
+const size_t FRAME_MIN_CAP = 256;
+
+/// \brief Footer following every frame
+struct Frame_foot
+{
+#ifdef CANARY
+                guard_t can           = 0;
+#endif
+#ifdef BUFFER_HASH
+                guard_t hash          = 0; ///< hash of frame
+#endif
+                uint64_t len          = 0; ///< length of frame
+};
+
+/// \brief Read-only view of frame (valid until next push or pop)
+struct Frame_view
+{
+                const void* data      = nullptr;
+                size_t len            = 0;
+};
+
+struct Frame_stack
+{
+#ifdef CANARY
+                guard_t beg_can       = 0;
+#endif
+#ifdef STACK_HASH
+                guard_t stk_hash      = 0;
+#endif
+
+                unsigned char* buffer = nullptr;
+
+                size_t size           = 0; ///< used bytes (frames with footers)
+                size_t capacity       = 0; ///< bytes
+                size_t frames         = 0; ///< number of frames
+
+#ifdef CANARY
+                guard_t end_can       = 0;
+#endif
+};
+
+//////////////////////////////////////////////////////////////////////////////
+/** \brief Verifies and dumps stack with its frames to logfile
+ *
+ *  \param stk [in] Pointer to stack
+ *  \param msg [in] String message for dump
+ */
+#ifdef DUMP
+#define frame_dump(stk, msg)                                                 \
+        frame_dump_((stk), (msg), __PRETTY_FUNCTION__, __FILE__, __LINE__)
+#else
+#define frame_dump(stk, msg)
+#endif // DUMP
+
+/** \brief Initializes empty stack
+ *
+ *  \param stk [in][out] Pointer to stack
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ */
+#define frame_init(stk)                                                      \
+        frame_init_((stk)                                                    \
+                         DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))   \
+
+/** \brief Pushes copy of frame to stack
+ *
+ *  \param stk  [in][out] Pointer to stack
+ *  \param data [in]      Pointer to frame
+ *  \param len  [in]      Length of frame in bytes
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ */
+#define frame_push(stk, data, len)                                           \
+        frame_push_((stk), (data), (len)                                     \
+                         DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))   \
+
+/** \brief Pops top frame in O(1)
+ *
+ *  \param stk [in][out] Pointer to stack
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ *  \warning Use frame_top to read frame before popping
+ */
+#define frame_pop(stk)                                                       \
+        frame_pop_((stk)                                                     \
+                         DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))   \
+
+/** \brief Gets view of top frame without copying it
+ *
+ *  \param stk  [in]  Pointer to stack
+ *  \param view [out] Pointer to view of frame
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ *  \warning View is invalidated by next push or pop
+ *  \warning Query of empty stack returns Stack_err::EMPT_STK
+ */
+#define frame_top(stk, view)                                                 \
+        frame_top_((stk), (view)                                             \
+                         DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))   \
+
+/** \brief Destroys stack
+ *
+ *  \param stk [in][out] Pointer to stack
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ */
+#define frame_dstr(stk)                                                      \
+        frame_dstr_((stk)                                                    \
+                         DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))   \
+
+//////////////////////////////////////////////////////////////////////////////
+
+Stack_err frame_verify_(const Frame_stack* const stk);
+
+/** \brief Cheap verification for push, pop and top: fields of stack and top frame
+ *         (frame below is checked when it becomes top, all frames are checked by frame_verify_)
+ */
+Stack_err frame_check_top_(const Frame_stack* const stk);
+
+Stack_err frame_init_(Frame_stack* stk
+              DUMP_ON(const char func[], const char file[], int line));
+
+Stack_err frame_push_(Frame_stack* stk, const void* data, size_t len
+              DUMP_ON(const char func[], const char file[], int line));
+
+Stack_err frame_pop_ (Frame_stack* stk
+              DUMP_ON(const char func[], const char file[], int line));
+
+Stack_err frame_top_ (const Frame_stack* stk, Frame_view* view
+              DUMP_ON(const char func[], const char file[], int line));
+
+Stack_err frame_dstr_(Frame_stack* stk
+              DUMP_ON(const char func[], const char file[], int line));
+
+#ifdef DUMP
+Stack_err frame_dump_(const Frame_stack* const stk, const char msg[],
+                      const char func[], const char file[], int line);
+#endif // DUMP
+
+#endif // FRAME_STACK_H
@@ -0,0 +1,173 @@
+/** \file
+ *  \brief Header containing tiered stack spilling its bottom to disk (POSIX only)
+ *
+ *  Elements are kept in segments of SPILL_SEG_CAP elements. Only hot_segs segments
+ *  from the top are kept in memory, colder ones are written to file by background
+ *  thread (optionally compressed) and prefetched back before pops reach them.
+ *  Every segment is hashed before spill and checked after reload. Pushes wait for
+ *  writes when disk is slower than them, so besides hot segments only one segment
+ *  waiting to be written is kept in memory.
+ */
+#ifndef SPILL_STACK_H
+#define SPILL_STACK_H
+
+#include <stdint.h>
+#include "Stack.h"
+
+/// \brief Number of elements in segment
+const size_t SPILL_SEG_CAP     = 1 << 16;
+/// \brief Default number of segments kept in memory
+const size_t SPILL_HOT_SEGS    = 4;
+
+/** \brief Function compressing (or decompressing) segment
+ *
+ *  \param dst    [out] Buffer to write to
+ *  \param dst_sz [in]  Size of buffer
+ *  \param src    [in]  Data to be compressed
+ *  \param src_sz [in]  Size of data
+ *
+ *  \return Size of written data or 0 if it does not fit (segment is stored uncompressed then)
+ */
+typedef size_t (*spill_codec_t)(void* dst, size_t dst_sz, const void* src, size_t src_sz);
+
+/// \brief Options of spilling
+struct Spill_opt
+{
+                const char*   path       = nullptr;         ///< file for cold segments, truncated and kept after destruction
+                                                                ///< (temporary file removed on close if nullptr)
+                size_t        hot_segs   = SPILL_HOT_SEGS;  ///< number of segments kept in memory (at least 2)
+                spill_codec_t compress   = nullptr;         ///< compression function (segments are not compressed if nullptr)
+                spill_codec_t decompress = nullptr;         ///< decompression function
+};
+
+/// \brief Statistics of spilling
+struct Spill_stats
+{
+                uint64_t spilled_bytes  = 0; ///< bytes written to file
+                uint64_t reloaded_bytes = 0; ///< bytes read from file
+                uint64_t spill_ns       = 0; ///< time spent on writing (including compression)
+                uint64_t reload_ns      = 0; ///< time spent on reading (including decompression)
+                uint64_t stall_ns       = 0; ///< time pop waited for reloads and push waited for writes
+                uint64_t stalls         = 0; ///< number of waits in pop and push
+};
+
+struct Spill_seg;
+struct Spill_io;
+
+/** \brief Stack spilling its bottom to disk
+ *
+ *  \warning Spilling thread keeps address of stack, so it must not be moved or copied
+ *           between spill_init and spill_dstr
+ */
+struct Spill_stack
+{
+#ifdef CANARY
+                guard_t beg_can       = 0;
+#endif
+#ifdef STACK_HASH
+                guard_t stk_hash      = 0;
+#endif
+
+                Spill_seg* segs       = nullptr;
+                Spill_io*  io         = nullptr;
+
+                size_t nsegs          = 0; ///< number of segments in use
+                size_t segs_cap       = 0; ///< capacity of segments table
+                size_t hot_beg        = 0; ///< lowest segment in memory (or being reloaded)
+                size_t hot_segs       = 0;
+
+                size_t top_size       = 0;
+                size_t size           = 0;
+
+#ifdef CANARY
+                guard_t end_can       = 0;
+#endif
+};
+
+//////////////////////////////////////////////////////////////////////////////
+/** \brief Verifies and dumps stack with spill statistics to logfile
+ *
+ *  \param stk [in] Pointer to stack
+ *  \param msg [in] String message for dump
+ */
+#ifdef DUMP
+#define spill_dump(stk, msg)                                                 \
+        spill_dump_((stk), (msg), __PRETTY_FUNCTION__, __FILE__, __LINE__)
+#else
+#define spill_dump(stk, msg)
+#endif // DUMP
+
+/** \brief Initializes stack and starts spilling thread
+ *
+ *  \param stk [in][out] Pointer to stack
+ *  \param opt [in]      Pointer to options (default options are used if nullptr)
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ */
+#define spill_init(stk, opt)                                                 \
+        spill_init_((stk), (opt)                                             \
+                         DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))   \
+
+/** \brief Pushes element to stack
+ *
+ *  \param stk  [in][out] Pointer to stack
+ *  \param elem [in]      Element to be pushed
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ *  \warning Returns Stack_err::BAD_BUF after spilled segment failed to be written (it is lost)
+ */
+#define spill_push(stk, elem)                                                \
+        spill_push_((stk), (elem)                                            \
+                         DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))   \
+
+/** \brief Pops element from stack
+ *
+ *  \param stk  [in][out] Pointer to stack
+ *  \param elem [out]     Pointer to variable to write popped element
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ *  \warning Returns Stack_err::BAD_BUF_HSH if reloaded segment is corrupted
+ */
+#define spill_pop(stk, elem)                                                 \
+        spill_pop_((stk), (elem)                                             \
+                         DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))   \
+
+/** \brief Destroys stack, stops spilling thread and closes file
+ *
+ *  \param stk [in][out] Pointer to stack
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ */
+#define spill_dstr(stk)                                                      \
+        spill_dstr_((stk)                                                    \
+                         DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))   \
+
+//////////////////////////////////////////////////////////////////////////////
+
+Stack_err spill_verify_(const Spill_stack* const stk);
+
+Stack_err spill_init_(Spill_stack* stk, const Spill_opt* opt
+              DUMP_ON(const char func[], const char file[], int line));
+
+Stack_err spill_push_(Spill_stack* stk, Elem_t elem
+              DUMP_ON(const char func[], const char file[], int line));
+
+Stack_err spill_pop_ (Spill_stack* stk, Elem_t* elem
+              DUMP_ON(const char func[], const char file[], int line));
+
+Stack_err spill_dstr_(Spill_stack* stk
+              DUMP_ON(const char func[], const char file[], int line));
+
+/** \brief Gets spill statistics
+ *
+ *  \param stk   [in]  Pointer to stack
+ *  \param stats [out] Pointer to statistics
+ */
+void spill_stats(const Spill_stack* stk, Spill_stats* stats);
+
+#ifdef DUMP
+Stack_err spill_dump_(const Spill_stack* const stk, const char msg[],
+                      const char func[], const char file[], int line);
+#endif // DUMP
+
+#endif // SPILL_STACK_H
@@ -0,0 +1,78 @@
+/** \file
+ *  \brief Header for stack buffer allocation with NUMA and huge pages placement
+ */
+#ifndef STACK_ALLOC_H
+#define STACK_ALLOC_H
+
+#include <stddef.h>
+
+/// \brief NUMA node is not specified (buffer is placed by first touch)
+const int STACK_NODE_ANY   = -1;
+/// \brief Buffer is placed on NUMA node of thread which initializes stack
+const int STACK_NODE_LOCAL = -2;
+
+/// \brief Size of huge page
+const size_t STACK_HUGE_PAGE_SZ = 2 << 20;
+
+/// \brief Huge pages mode
+enum Stack_huge
+{
+    HUGE_NONE     = 0, ///< regular pages
+    HUGE_THP      = 1, ///< transparent huge pages (madvise)
+    HUGE_EXPLICIT = 2, ///< explicit huge pages (hugetlbfs), falls back to HUGE_THP if none are available
+};
+
+/// \brief Placement options of stack buffer
+struct Stack_alloc
+{
+                int    node           = STACK_NODE_ANY; ///< NUMA node (or STACK_NODE_ANY, STACK_NODE_LOCAL)
+                int    huge           = HUGE_NONE;      ///< requested huge pages mode (Stack_huge)
+                size_t huge_threshold = 0;              ///< buffer size in bytes starting from which huge pages are used
+                bool   fixed          = false;          ///< capacity is set at init (not less than STACK_MIN_CAP) and never changes
+
+                int    huge_used      = HUGE_NONE;      ///< huge pages mode of current buffer (set by allocator)
+                int    node_used      = STACK_NODE_ANY; ///< node current buffer is bound to (set by allocator,
+                                                        ///< STACK_NODE_ANY if binding failed)
+};
+
+/** \brief Reallocates buffer according to placement options (realloc is used if no options are set)
+ *
+ *  \param ptr       [in]     Buffer to reallocate (or nullptr)
+ *  \param old_bytes [in]     Size of buffer
+ *  \param new_bytes [in]     New size of buffer
+ *  \param alloc     [in][out] Placement options (huge_used and node_used are updated)
+ *
+ *  \return Pointer to new buffer or nullptr (old buffer is not freed then)
+ *  \note Mapped buffers are resized with mremap where possible, so pages are moved without copying
+ */
+void* stack_mem_realloc(void* ptr, size_t old_bytes, size_t new_bytes, Stack_alloc* alloc);
+
+/** \brief Frees buffer allocated with stack_mem_realloc
+ *
+ *  \param ptr    [in] Buffer
+ *  \param nbytes [in] Size of buffer
+ *  \param alloc  [in] Placement options used for allocation
+ */
+void stack_mem_free(void* ptr, size_t nbytes, const Stack_alloc* alloc);
+
+/** \brief Touches every page of buffer (without changing it), so no page faults happen later
+ *
+ *  \param ptr    [in] Buffer
+ *  \param nbytes [in] Size of buffer
+ *  \param alloc  [in] Placement options used for allocation (page size depends on huge_used, may be nullptr)
+ */
+void stack_mem_prefault(void* ptr, size_t nbytes, const Stack_alloc* alloc);
+
+/** \brief Resolves STACK_NODE_LOCAL to node of calling thread
+ *
+ *  \return NUMA node or STACK_NODE_ANY if it is unknown
+ */
+int stack_mem_local_node();
+
+/** \brief Gets NUMA node where page containing ptr is placed
+ *
+ *  \return NUMA node or STACK_NODE_ANY if it is unknown
+ */
+int stack_mem_node(const void* ptr);
+
+#endif // STACK_ALLOC_H
@@ -0,0 +1,185 @@
+/** \file
+ *  \brief Header containing bundle of independent stacks advanced in lockstep
+ *
+ *  Stacks (lanes) of bundle share one buffer of rows, slot i of every lane is
+ *  kept in row i: buffer[i * lanes + lane]. One call pushes (or pops) a vector of
+ *  values, one per lane selected by mask. While selected lanes have equal sizes
+ *  (no divergence) a vector is one contiguous row, otherwise it is scattered
+ *  (gathered) by lane sizes. Push and pop of all lanes in lockstep are inlined
+ *  without PROTECT.
+ */
+#ifndef STACK_BUNDLE_H
+#define STACK_BUNDLE_H
+
+#include <stdint.h>
+#include <string.h>
+#include "Stack.h"
+
+/// \brief Maximal number of lanes in bundle
+const size_t BUNDLE_MAX_LANES = 16;
+
+/// \brief Mask of lanes (bit i selects lane i)
+typedef uint32_t bundle_mask_t;
+
+/// \brief Mask selecting all lanes
+const bundle_mask_t BUNDLE_ALL = ~(bundle_mask_t) 0;
+
+struct Stack_bundle
+{
+#ifdef CANARY
+                guard_t beg_can       = 0;
+#endif
+#ifdef STACK_HASH
+                guard_t stk_hash      = 0;
+#endif
+
+                Elem_t* buffer        = nullptr;
+
+                size_t lanes          = 0;
+                size_t capacity       = 0; ///< number of rows
+                size_t rows           = 0; ///< maximal size of lanes
+                bool   lockstep       = true; ///< all lanes have equal sizes
+                size_t size[BUNDLE_MAX_LANES] = {};
+
+#ifdef BUFFER_HASH
+                guard_t buf_hash      = 0;
+#endif
+#ifdef CANARY
+                guard_t end_can       = 0;
+#endif
+};
+
+//////////////////////////////////////////////////////////////////////////////
+/** \brief Verifies and dumps bundle to logfile
+ *
+ *  \param stk [in] Pointer to bundle
+ *  \param msg [in] String message for dump
+ */
+#ifdef DUMP
+#define bundle_dump(stk, msg)                                                \
+        bundle_dump_((stk), (msg), __PRETTY_FUNCTION__, __FILE__, __LINE__)
+#else
+#define bundle_dump(stk, msg)
+#endif // DUMP
+
+/** \brief Initializes bundle of empty stacks
+ *
+ *  \param stk   [in][out] Pointer to bundle
+ *  \param lanes [in]      Number of stacks (from 1 to BUNDLE_MAX_LANES)
+ *  \param size  [in]      Initial size for every stack (if 0 buffer is not allocated)
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ */
+#define bundle_init(stk, lanes, size)                                        \
+        bundle_init_((stk), (lanes), (size)                                  \
+                         DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))   \
+
+/** \brief Pushes vals[lane] to every lane selected by mask
+ *
+ *  \param stk  [in][out] Pointer to bundle
+ *  \param vals [in]      Array of stk->lanes elements (elements of unselected lanes are ignored)
+ *  \param mask [in]      Selected lanes (BUNDLE_ALL for all lanes)
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ */
+#define bundle_push(stk, vals, mask)                                         \
+        bundle_push_fast_((stk), (vals), (mask)                              \
+                         DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))   \
+
+/** \brief Pops top of every lane selected by mask to vals[lane]
+ *
+ *  \param stk  [in][out] Pointer to bundle
+ *  \param vals [out]     Array of stk->lanes elements (elements of unselected lanes are not changed)
+ *  \param mask [in]      Selected lanes (BUNDLE_ALL for all lanes)
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ *  \warning If any of selected lanes is empty Stack_err::POP_EMPT_STK is returned and no lane is popped
+ */
+#define bundle_pop(stk, vals, mask)                                          \
+        bundle_pop_fast_((stk), (vals), (mask)                               \
+                         DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))   \
+
+/** \brief Destroys bundle
+ *
+ *  \param stk [in][out] Pointer to bundle
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ */
+#define bundle_dstr(stk)                                                     \
+        bundle_dstr_((stk)                                                   \
+                         DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))   \
+
+//////////////////////////////////////////////////////////////////////////////
+
+Stack_err bundle_verify_(const Stack_bundle* const stk);
+
+Stack_err bundle_init_(Stack_bundle* stk, size_t lanes, size_t preset_cap
+              DUMP_ON(const char func[], const char file[], int line));
+
+Stack_err bundle_push_(Stack_bundle* stk, const Elem_t vals[], bundle_mask_t mask
+              DUMP_ON(const char func[], const char file[], int line));
+
+Stack_err bundle_pop_ (Stack_bundle* stk, Elem_t vals[], bundle_mask_t mask
+              DUMP_ON(const char func[], const char file[], int line));
+
+Stack_err bundle_dstr_(Stack_bundle* stk
+              DUMP_ON(const char func[], const char file[], int line));
+
+#ifdef DUMP
+Stack_err bundle_dump_(const Stack_bundle* const stk, const char msg[],
+                       const char func[], const char file[], int line);
+#endif // DUMP
+
+//////////////////////////////////////////////////////////////////////////////
+// Fast path: without protection push and pop of all lanes in lockstep are one
+// row copy, masks, divergence, resize and errors go to bundle_*_ functions
+
+/// \brief Checks that mask selects every lane
+inline bool bundle_all_(const Stack_bundle* stk, bundle_mask_t mask)
+{
+    bundle_mask_t all = (bundle_mask_t) ((1ULL << stk->lanes) - 1);
+
+    return (mask & all) == all;
+}
+
+inline Stack_err bundle_push_fast_(Stack_bundle* stk, const Elem_t vals[], bundle_mask_t mask
+              DUMP_ON(const char func[], const char file[], int line))
+{
+#ifndef PROTECT
+    if(STACK_LIKELY(stk->lockstep && stk->rows < stk->capacity && vals && bundle_all_(stk, mask)))
+    {
+        memcpy(stk->buffer + stk->rows * stk->lanes, vals, stk->lanes * sizeof(Elem_t));
+
+        for(size_t lane = 0; lane < stk->lanes; lane++)
+            stk->size[lane]++;
+        stk->rows++;
+
+        return Stack_err::NOERR;
+    }
+#endif // PROTECT
+
+    return bundle_push_(stk, vals, mask DUMP_ON(func, file, line));
+}
+
+inline Stack_err bundle_pop_fast_(Stack_bundle* stk, Elem_t vals[], bundle_mask_t mask
+              DUMP_ON(const char func[], const char file[], int line))
+{
+#ifndef PROTECT
+    // Popped row must not shrink buffer
+    if(STACK_LIKELY(stk->lockstep && stk->rows && (stk->rows - 1) * STACK_CAP_MULTPLR * STACK_CAP_MULTPLR > stk->capacity &&
+                    vals && bundle_all_(stk, mask)))
+    {
+        stk->rows--;
+        memcpy(vals, stk->buffer + stk->rows * stk->lanes, stk->lanes * sizeof(Elem_t));
+
+        for(size_t lane = 0; lane < stk->lanes; lane++)
+            stk->size[lane]--;
+
+        return Stack_err::NOERR;
+    }
+#endif // PROTECT
+
+    return bundle_pop_(stk, vals, mask DUMP_ON(func, file, line));
+}
+
+#endif // STACK_BUNDLE_H
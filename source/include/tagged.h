@@ -0,0 +1,225 @@
+/** \file
+ *  \brief Header for NaN-boxed tagged values stored in stack of double
+ *
+ *  Numbers are stored as is (NaNs are canonicalized), other types are packed
+ *  into payload of negative quiet NaN with type in bits 48-50.
+ */
+#ifndef TAGGED_H
+#define TAGGED_H
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include "Stack.h"
+
+static_assert(sizeof(Elem_t) == sizeof(uint64_t), "Tagged values require 8-byte Elem_t");
+
+/// \brief Type of tagged value
+enum Tag_type
+{
+    TAG_NUM  = 0, ///< double
+    TAG_NIL  = 1, ///< no value
+    TAG_BOOL = 2, ///< boolean
+    TAG_INT  = 3, ///< 32-bit integer
+    TAG_PTR  = 4, ///< pointer (48-bit address)
+};
+
+const uint64_t TAG_BOX_MASK   = 0xFFF8000000000000;
+const uint64_t TAG_TYPE_MASK  = 0x0007000000000000;
+const uint64_t TAG_VAL_MASK   = 0x0000FFFFFFFFFFFF;
+const int      TAG_TYPE_SHIFT = 48;
+const uint64_t TAG_NAN        = 0x7FF8000000000000;
+
+inline uint64_t tag_bits_(Elem_t elem)
+{
+    uint64_t bits = 0;
+    memcpy(&bits, &elem, sizeof(bits));
+
+    return bits;
+}
+
+inline Elem_t tag_box_(uint64_t bits)
+{
+    Elem_t elem = 0;
+    memcpy(&elem, &bits, sizeof(elem));
+
+    return elem;
+}
+
+inline Elem_t tag_make_(Tag_type type, uint64_t val)
+{
+    return tag_box_(TAG_BOX_MASK | ((uint64_t) type << TAG_TYPE_SHIFT) | (val & TAG_VAL_MASK));
+}
+
+/// \brief Returns type of tagged value
+inline Tag_type tag_type(Elem_t elem)
+{
+    uint64_t bits = tag_bits_(elem);
+
+    if((bits & TAG_BOX_MASK) != TAG_BOX_MASK)
+        return TAG_NUM;
+
+    return (Tag_type) ((bits & TAG_TYPE_MASK) >> TAG_TYPE_SHIFT);
+}
+
+inline Elem_t tag_num(double val)
+{
+    return val != val ? tag_box_(TAG_NAN) : val;
+}
+
+inline Elem_t tag_nil()
+{
+    return tag_make_(TAG_NIL, 0);
+}
+
+inline Elem_t tag_bool(bool val)
+{
+    return tag_make_(TAG_BOOL, val);
+}
+
+inline Elem_t tag_int(int32_t val)
+{
+    return tag_make_(TAG_INT, (uint32_t) val);
+}
+
+inline Elem_t tag_ptr(const void* val)
+{
+    assert(((uintptr_t) val & ~TAG_VAL_MASK) == 0);
+
+    return tag_make_(TAG_PTR, (uintptr_t) val);
+}
+
+inline double tag_as_num(Elem_t elem)
+{
+    return elem;
+}
+
+inline bool tag_as_bool(Elem_t elem)
+{
+    return tag_bits_(elem) & 1;
+}
+
+inline int32_t tag_as_int(Elem_t elem)
+{
+    return (int32_t) (uint32_t) tag_bits_(elem);
+}
+
+inline void* tag_as_ptr(Elem_t elem)
+{
+    return (void*) (uintptr_t) (tag_bits_(elem) & TAG_VAL_MASK);
+}
+
+/** \brief Formats tagged value with its type (can be passed to stack_dump_set_format)
+ *
+ *  \param dst    [out] Buffer to write to
+ *  \param dst_sz [in]  Size of buffer
+ *  \param elem   [in]  Element to format
+ *
+ *  \return Number of written bytes
+ */
+size_t stack_format_tagged(char dst[], size_t dst_sz, const Elem_t* elem);
+
+//////////////////////////////////////////////////////////////////////////////
+/** \brief Pushes typed value to stack
+ *
+ *  \param stk [in][out] Pointer to stack
+ *  \param val [in]      Value to be pushed
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ */
+#define stack_push_num(stk, val)  stack_push((stk), tag_num(val))
+#define stack_push_nil(stk)       stack_push((stk), tag_nil())
+#define stack_push_bool(stk, val) stack_push((stk), tag_bool(val))
+#define stack_push_int(stk, val)  stack_push((stk), tag_int(val))
+#define stack_push_ptr(stk, val)  stack_push((stk), tag_ptr(val))
+
+/** \brief Pops value of requested type from stack
+ *
+ *  \param stk  [in][out] Pointer to stack
+ *  \param type [in]      Expected type of top element
+ *  \param elem [out]     Pointer to variable to write popped element
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ *  \warning If type of top element mismatches, stack is not changed and Stack_err::BAD_TYPE is returned
+ */
+#define stack_pop_tagged(stk, type, elem)                                    \
+        stack_pop_tagged_((stk), (type), (elem)                              \
+                        DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))    \
+
+/** \brief Pops typed value from stack (see stack_pop_tagged)
+ *
+ *  \param stk [in][out] Pointer to stack
+ *  \param val [out]     Pointer to variable to write popped value
+ *
+ *  \return Stack_err::NOERR if succeed and error number otherwise
+ */
+#define stack_pop_num(stk, val)                                              \
+        stack_pop_num_((stk), (val)                                          \
+                        DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))    \
+
+#define stack_pop_bool(stk, val)                                             \
+        stack_pop_bool_((stk), (val)                                         \
+                        DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))    \
+
+#define stack_pop_int(stk, val)                                              \
+        stack_pop_int_((stk), (val)                                          \
+                        DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))    \
+
+#define stack_pop_ptr(stk, val)                                              \
+        stack_pop_ptr_((stk), (val)                                          \
+                        DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__))    \
+
+//////////////////////////////////////////////////////////////////////////////
+
+Stack_err stack_pop_tagged_(Stack* stk, Tag_type type, Elem_t* elem
+              DUMP_ON(const char func[], const char file[], int line));
+
+inline Stack_err stack_pop_num_(Stack* stk, double* val
+              DUMP_ON(const char func[], const char file[], int line))
+{
+    Elem_t elem = 0;
+    Stack_err err = stack_pop_tagged_(stk, TAG_NUM, val ? &elem : nullptr
+                                      DUMP_ON(func, file, line));
+    if(!err)
+        *val = tag_as_num(elem);
+
+    return err;
+}
+
+inline Stack_err stack_pop_bool_(Stack* stk, bool* val
+              DUMP_ON(const char func[], const char file[], int line))
+{
+    Elem_t elem = 0;
+    Stack_err err = stack_pop_tagged_(stk, TAG_BOOL, val ? &elem : nullptr
+                                      DUMP_ON(func, file, line));
+    if(!err)
+        *val = tag_as_bool(elem);
+
+    return err;
+}
+
+inline Stack_err stack_pop_int_(Stack* stk, int32_t* val
+              DUMP_ON(const char func[], const char file[], int line))
+{
+    Elem_t elem = 0;
+    Stack_err err = stack_pop_tagged_(stk, TAG_INT, val ? &elem : nullptr
+                                      DUMP_ON(func, file, line));
+    if(!err)
+        *val = tag_as_int(elem);
+
+    return err;
+}
+
+inline Stack_err stack_pop_ptr_(Stack* stk, void** val
+              DUMP_ON(const char func[], const char file[], int line))
+{
+    Elem_t elem = 0;
+    Stack_err err = stack_pop_tagged_(stk, TAG_PTR, val ? &elem : nullptr
+                                      DUMP_ON(func, file, line));
+    if(!err)
+        *val = tag_as_ptr(elem);
+
+    return err;
+}
+
+#endif // TAGGED_H
@@ -0,0 +1,101 @@
+/** \file
+ *  \brief Header for recording stack operations to trace file and reading them back
+ *
+ *  With TRACE defined init, push, pop and destruction of every stack are recorded
+ *  (operation, stack id, element or capacity, time). Records are varint-encoded and
+ *  collected in per-thread blocks, every block is written to trace with one fwrite.
+ *  Trace is read with trace_open/trace_read (available without TRACE, e.g. for replay).
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include "config.h"
+
+#ifndef __USE_MINGW_ANSI_STDIO
+#define __USE_MINGW_ANSI_STDIO 1
+#endif
+#include <stdio.h>
+
+/// \brief Signature at the beginning of trace file
+const char TRACE_MAGIC[8]     = {'S', 'T', 'K', 'T', 'R', 'A', 'C', 'E'};
+/// \brief Version of trace format
+const unsigned char TRACE_VER = 1;
+/// \brief Maximal size of block of records
+const size_t TRACE_BLOCK_SZ   = 1 << 16;
+
+/// \brief Traced operation
+enum Trace_op
+{
+    TRACE_INIT = 1, ///< stack_init_ (with capacity)
+    TRACE_PUSH = 2, ///< stack_push_ (with element)
+    TRACE_POP  = 3, ///< stack_pop_
+    TRACE_DSTR = 4, ///< stack_dstr_
+};
+
+/// \brief Record of trace
+struct Trace_rec
+{
+                int      op       = 0;
+                uint64_t id       = 0; ///< id of stack (0 for stack which was not initialized)
+                uint64_t time_ns  = 0; ///< time since beginning of trace
+                size_t   capacity = 0; ///< initial capacity (TRACE_INIT)
+                Elem_t   elem     = {}; ///< pushed element (TRACE_PUSH)
+};
+
+/// \brief Reader of trace file
+struct Trace_reader
+{
+                FILE*    stream   = nullptr;
+                size_t   len      = 0; ///< size of current block
+                size_t   pos      = 0; ///< position in current block
+                uint64_t time_ns  = 0; ///< time of previous record in block
+
+                unsigned char block[TRACE_BLOCK_SZ];
+};
+
+/** \brief Sets stream for trace
+ *
+ *  \param tracestream Stream for trace (if 0 passed STACK_TRACEFILE is opened)
+ *  \warning Should be called before first stack is initialized (otherwise STACK_TRACEFILE is used)
+ */
+void stack_trace_init(FILE* tracestream);
+
+/// \brief Writes buffered records of calling thread to trace (done automatically on thread exit)
+void stack_trace_flush();
+
+/** \brief Starts reading of trace
+ *
+ *  \param reader [out] Pointer to reader
+ *  \param stream [in]  Trace stream opened for binary reading
+ *
+ *  \return 0 if succeed and -1 if stream is not a trace (or has different Elem_t)
+ */
+int trace_open(Trace_reader* reader, FILE* stream);
+
+/** \brief Reads next record of trace
+ *
+ *  \param reader [in][out] Pointer to reader
+ *  \param rec    [out]     Pointer to record
+ *
+ *  \return 1 if record is read, 0 at the end of trace and -1 if trace is corrupted
+ *  \warning Blocks of different threads are not ordered by time, sort records by time_ns if stacks were
+ *           shared between threads
+ */
+int trace_read(Trace_reader* reader, Trace_rec* rec);
+
+#ifdef TRACE
+/// \brief Gets id for new stack
+uint64_t trace_new_id_();
+
+/** \brief Records operation
+ *
+ *  \param op       [in] Operation
+ *  \param id       [in] Id of stack
+ *  \param elem     [in] Pointer to pushed element (TRACE_PUSH only)
+ *  \param capacity [in] Initial capacity (TRACE_INIT only)
+ */
+void trace_op_(Trace_op op, uint64_t id, const Elem_t* elem, size_t capacity);
+#endif // TRACE
+
+#endif // TRACE_H
@@ -0,0 +1,860 @@
+#include "include/config.h"
+#include "include/Stack.h"
+#include "include/spill_stack.h"
+#include "include/stack_hash.h"
+
+#ifndef __USE_MINGW_ANSI_STDIO
+#define __USE_MINGW_ANSI_STDIO 1
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/// \brief Segment of stack
+struct Spill_seg
+{
+    Elem_t* data;      ///< nullptr if segment is on disk
+    size_t  pending;   ///< number of queued requests for segment
+    off_t   offset;    ///< offset in file
+    size_t  nbytes;    ///< size in file
+    uint64_t hash;     ///< hash of elements (checked after reload)
+    bool    packed;    ///< segment is compressed in file
+    bool    corrupted; ///< reloaded segment does not match its hash
+};
+
+enum Spill_op
+{
+    SPILL_WRITE = 0,
+    SPILL_READ  = 1,
+};
+
+struct Spill_req
+{
+    Spill_op op;
+    size_t   seg;
+    Elem_t*  buf;      ///< buffer to read segment to
+};
+
+/// \brief State shared with spilling thread (protected by mutex)
+struct Spill_io
+{
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t  wake;     ///< signals spilling thread about new requests
+    pthread_cond_t  done;     ///< signals stack about finished requests
+
+    Spill_req*      queue;
+    size_t          q_head;
+    size_t          q_len;
+    size_t          q_cap;
+    size_t          q_writes;  ///< number of queued writes (their buffers are still in memory)
+
+    Elem_t**        free_bufs;
+    size_t          nfree;
+    size_t          free_cap;
+
+    int             fd;
+    spill_codec_t   compress;
+    spill_codec_t   decompress;
+    char*           pack_buf;  ///< used by spilling thread only
+
+    bool            stop;      ///< spilling thread should exit (queued requests are dropped)
+    bool            top_wait;  ///< top segment may still be being reloaded or is corrupted (used by stack owner only)
+    int             io_err;    ///< set under mutex, read by push without it (atomically)
+    Spill_stats     stats;
+};
+
+/// Size of segment in bytes
+const size_t SEG_BYTES = SPILL_SEG_CAP * sizeof(Elem_t);
+
+static void* spill_thread_(void* arg);
+static Elem_t* spill_get_buf_(Spill_io* io);
+static void spill_put_buf_(Spill_io* io, Elem_t* buf);
+static int spill_enqueue_(Spill_stack* stk, Spill_op op, size_t seg, Elem_t* buf);
+static int spill_reload_(Spill_stack* stk, size_t seg);
+static int spill_wait_top_(Spill_stack* stk);
+static int spill_wait_writes_(Spill_stack* stk);
+static void spill_set_guards_(Spill_stack* stk);
+static uint64_t spill_time_ns_();
+
+#ifdef DUMP
+static void spill_dump_lvl_(const Spill_stack* const stk, Stack_err err, Stack_dump_lvl level, const char msg[],
+                            const char func[], const char file[], int line);
+
+    #ifdef DUMP_ALL
+        #define DO_DUMP spill_dump_lvl_(stk, (Stack_err) err, Stack_dump_lvl::BRIEF, __func__, func, file, line)
+    #else
+        #define DO_DUMP spill_dump_lvl_(stk, (Stack_err) err, Stack_dump_lvl::ONLYERR, __func__, func, file, line)
+    #endif // DUMP_ALL
+#else
+    #define DO_DUMP
+#endif // DUMP
+
+#define ASSERT(condition, error)        \
+    do                                  \
+    {                                   \
+        if(STACK_UNLIKELY(!(condition)))\
+        {                               \
+            err |= error;               \
+            DO_DUMP;                    \
+            return (Stack_err) err;     \
+        }                               \
+    } while(0)                          \
+
+#define SEGS_ (stk->segs)
+#define NSEGS_ (stk->nsegs)
+#define TOP_SZ_ (stk->top_size)
+#define SZ_ (stk->size)
+#define IO_ (stk->io)
+
+////////////////////////////////////////////////////////////////
+#ifdef PROTECT
+static Spill_io* const IO_POISON = (Spill_io*) 0x000000000BAD;
+
+static guard_t spill_hash_(const Spill_stack* stk)
+{
+    assert(stk);
+
+    return qhashfnv1_64(&stk->segs, (const char*) (&stk->size + 1) - (const char*) &stk->segs);
+}
+
+Stack_err spill_verify_(const Spill_stack* const stk)
+{
+    int err = Stack_err::NOERR;
+
+    if(!stk)
+        return Stack_err::NULLPTR;
+
+    if(IO_ == IO_POISON)
+        return Stack_err::DSTRCTED;
+
+    if(NSEGS_ > stk->segs_cap || stk->hot_beg > NSEGS_ || TOP_SZ_ > SPILL_SEG_CAP)
+        return Stack_err::SZ_OVR_CAP;
+
+    if((NSEGS_ && (!SEGS_ || !TOP_SZ_)) || SZ_ != (NSEGS_ ? (NSEGS_ - 1) * SPILL_SEG_CAP + TOP_SZ_ : 0))
+        return Stack_err::BAD_BUF;
+
+#ifdef CANARY
+    if(stk->beg_can != DEFAULT_CANARY || stk->end_can != DEFAULT_CANARY)
+        err |= Stack_err::BAD_STK_CAN;
+#endif
+#ifdef STACK_HASH
+    if(stk->stk_hash != spill_hash_(stk))
+        err |= Stack_err::BAD_STK_HSH;
+#endif
+
+    return (Stack_err) err;
+}
+#endif // PROTECT ////////////////////////////////////////////////
+
+Stack_err spill_init_(Spill_stack* stk, const Spill_opt* opt
+              DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
+    ASSERT(stk, Stack_err::NULLPTR);
+
+    ASSERT(IO_ != IO_POISON, Stack_err::DSTRCTED);
+
+    ASSERT(!IO_, Stack_err::REINIT);
+#endif // PROTECT
+
+    Spill_opt def_opt = {};
+    if(!opt)
+        opt = &def_opt;
+
+    Spill_io* io = (Spill_io*) calloc(1, sizeof(Spill_io));
+    ASSERT(io, Stack_err::BAD_ALLOC);
+
+    io->compress   = opt->compress;
+    io->decompress = opt->decompress;
+    io->free_cap   = opt->hot_segs + 1;
+    io->free_bufs  = (Elem_t**) calloc(io->free_cap, sizeof(Elem_t*));
+    io->pack_buf   = opt->compress ? (char*) malloc(SEG_BYTES) : nullptr;
+
+    char tmp_path[] = "/tmp/stack_spill_XXXXXX";
+    const char* path = opt->path ? opt->path : tmp_path;
+
+    if(opt->path)
+        io->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    else
+        io->fd = mkstemp(tmp_path);
+
+    if(!io->free_bufs || (opt->compress && !io->pack_buf) || io->fd < 0)
+    {
+        if(io->fd >= 0)
+            close(io->fd);
+
+        free(io->pack_buf);
+        free(io->free_bufs);
+        free(io);
+
+        ASSERT(0, Stack_err::BAD_ALLOC);
+    }
+
+    // Temporary file is used as anonymous storage, it is removed when closed (file named by user is kept)
+    if(!opt->path)
+        unlink(path);
+
+    pthread_mutex_init(&io->mutex, nullptr);
+    pthread_cond_init(&io->wake, nullptr);
+    pthread_cond_init(&io->done, nullptr);
+
+    IO_           = io;
+    SEGS_         = nullptr;
+    NSEGS_        = 0;
+    stk->segs_cap = 0;
+    stk->hot_beg  = 0;
+    stk->hot_segs = opt->hot_segs < 2 ? 2 : opt->hot_segs;
+    TOP_SZ_       = 0;
+    SZ_           = 0;
+
+    if(pthread_create(&io->thread, nullptr, &spill_thread_, stk) != 0)
+    {
+        pthread_mutex_destroy(&io->mutex);
+        pthread_cond_destroy(&io->wake);
+        pthread_cond_destroy(&io->done);
+
+        close(io->fd);
+        free(io->pack_buf);
+        free(io->free_bufs);
+        free(io);
+        IO_ = nullptr;
+
+        ASSERT(0, Stack_err::BAD_ALLOC);
+    }
+
+    spill_set_guards_(stk);
+
+#ifdef PROTECT
+    err |= spill_verify_(stk);
+    DO_DUMP;
+#endif // PROTECT
+
+    return (Stack_err) err;
+}
+
+Stack_err spill_push_(Spill_stack* stk, Elem_t elem
+              DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
+    err = spill_verify_(stk);
+    ASSERT(!err, err);
+#endif // PROTECT
+
+    // Segment failed to be written is lost, so pushes are not accepted anymore
+    int io_err = __atomic_load_n(&IO_->io_err, __ATOMIC_RELAXED);
+    ASSERT(!io_err, io_err);
+
+    if(STACK_UNLIKELY(IO_->top_wait))
+    {
+        err |= spill_wait_top_(stk);
+        ASSERT(!err, err);
+    }
+
+    if(STACK_UNLIKELY(!NSEGS_ || TOP_SZ_ == SPILL_SEG_CAP))
+    {
+        if(NSEGS_ - stk->hot_beg >= stk->hot_segs)
+        {
+            ASSERT(spill_enqueue_(stk, SPILL_WRITE, stk->hot_beg, nullptr) == 0, Stack_err::BAD_ALLOC);
+            stk->hot_beg++;
+            spill_set_guards_(stk);
+
+            // If disk is slower than pushes, they wait for writes (otherwise memory would grow unbounded)
+            err |= spill_wait_writes_(stk);
+            ASSERT(!err, err);
+        }
+
+        if(NSEGS_ == stk->segs_cap)
+        {
+            size_t new_cap = stk->segs_cap ? stk->segs_cap * STACK_CAP_MULTPLR : STACK_MIN_CAP;
+
+            // Segments table is read by spilling thread
+            pthread_mutex_lock(&IO_->mutex);
+            Spill_seg* segs = (Spill_seg*) realloc(SEGS_, new_cap * sizeof(Spill_seg));
+            if(segs)
+            {
+                SEGS_ = segs;
+                stk->segs_cap = new_cap;
+            }
+            pthread_mutex_unlock(&IO_->mutex);
+
+            ASSERT(segs, Stack_err::BAD_ALLOC);
+        }
+
+        Elem_t* buf = spill_get_buf_(IO_);
+        ASSERT(buf, Stack_err::BAD_ALLOC);
+
+        memset(&SEGS_[NSEGS_], 0, sizeof(Spill_seg));
+        SEGS_[NSEGS_].data = buf;
+
+        NSEGS_++;
+        TOP_SZ_ = 0;
+    }
+
+    SEGS_[NSEGS_ - 1].data[TOP_SZ_++] = elem;
+    SZ_++;
+
+    spill_set_guards_(stk);
+
+#ifdef PROTECT
+    err = spill_verify_(stk);
+    DO_DUMP;
+#endif // PROTECT
+
+    return (Stack_err) err;
+}
+
+Stack_err spill_pop_(Spill_stack* stk, Elem_t* elem
+             DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
+    err = spill_verify_(stk);
+    ASSERT(!err, err);
+
+    ASSERT(elem, Stack_err::NULLPTR);
+#endif // PROTECT
+
+    ASSERT(SZ_, Stack_err::POP_EMPT_STK);
+
+    if(STACK_UNLIKELY(IO_->top_wait))
+    {
+        err |= spill_wait_top_(stk);
+        ASSERT(!err, err);
+    }
+
+    *elem = SEGS_[NSEGS_ - 1].data[--TOP_SZ_];
+    SZ_--;
+
+    if(STACK_UNLIKELY(TOP_SZ_ == 0))
+    {
+        spill_put_buf_(IO_, SEGS_[NSEGS_ - 1].data);
+        SEGS_[NSEGS_ - 1].data = nullptr;
+        NSEGS_--;
+
+        if(NSEGS_)
+        {
+            TOP_SZ_ = SPILL_SEG_CAP;
+
+            // Next operation waits for new top segment (and queues its reload if it can't be queued here)
+            IO_->top_wait = true;
+
+            // Half of hot window is prefetched, so pops rarely wait for reload
+            while(stk->hot_beg && NSEGS_ - stk->hot_beg < stk->hot_segs / 2)
+            {
+                if(spill_reload_(stk, stk->hot_beg - 1) != 0)
+                    break;
+
+                stk->hot_beg--;
+            }
+        }
+        else
+        {
+            stk->hot_beg = 0;
+        }
+    }
+
+    spill_set_guards_(stk);
+
+#ifdef PROTECT
+    err = spill_verify_(stk);
+    DO_DUMP;
+#endif // PROTECT
+
+    return (Stack_err) err;
+}
+
+Stack_err spill_dstr_(Spill_stack* stk
+              DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
+    err = spill_verify_(stk);
+
+    ASSERT(stk, Stack_err::NULLPTR);
+
+    ASSERT(IO_ != IO_POISON, Stack_err::DSTRCTED);
+#endif // PROTECT
+
+    if(IO_)
+    {
+        pthread_mutex_lock(&IO_->mutex);
+        IO_->stop = true;
+        pthread_cond_signal(&IO_->wake);
+        pthread_mutex_unlock(&IO_->mutex);
+
+        pthread_join(IO_->thread, nullptr);
+
+        // Buffers of dropped reloads
+        for(size_t iter = 0; iter < IO_->q_len; iter++)
+        {
+            Spill_req* req = &IO_->queue[(IO_->q_head + iter) % IO_->q_cap];
+            if(req->op == SPILL_READ)
+                free(req->buf);
+        }
+
+        for(size_t iter = 0; iter < NSEGS_; iter++)
+            free(SEGS_[iter].data);
+
+        for(size_t iter = 0; iter < IO_->nfree; iter++)
+            free(IO_->free_bufs[iter]);
+
+        pthread_mutex_destroy(&IO_->mutex);
+        pthread_cond_destroy(&IO_->wake);
+        pthread_cond_destroy(&IO_->done);
+
+        close(IO_->fd);
+
+        free(IO_->queue);
+        free(IO_->free_bufs);
+        free(IO_->pack_buf);
+        free(IO_);
+    }
+
+    free(SEGS_);
+
+#ifdef PROTECT
+    IO_           = IO_POISON;
+    SEGS_         = nullptr;
+    NSEGS_        = SIZE_POISON;
+    stk->segs_cap = SIZE_POISON;
+    TOP_SZ_       = SIZE_POISON;
+    SZ_           = SIZE_POISON;
+
+#ifdef STACK_HASH
+    stk->stk_hash = SIZE_POISON;
+#endif
+#ifdef CANARY
+    stk->beg_can = (guard_t) SIZE_POISON;
+    stk->end_can = (guard_t) SIZE_POISON;
+#endif
+
+    DO_DUMP;
+#endif // PROTECT
+
+    return (Stack_err) err;
+}
+
+void spill_stats(const Spill_stack* stk, Spill_stats* stats)
+{
+    assert(stk && stk->io && stats);
+
+    pthread_mutex_lock(&stk->io->mutex);
+    *stats = stk->io->stats;
+    pthread_mutex_unlock(&stk->io->mutex);
+}
+
+////////////////////////////////////////////////////////////////
+static int spill_write_all_(int fd, const void* data, size_t nbytes, off_t offset)
+{
+    const char* ptr = (const char*) data;
+
+    while(nbytes)
+    {
+        ssize_t written = pwrite(fd, ptr, nbytes, offset);
+        if(written < 0 && errno == EINTR)
+            continue;
+        if(written <= 0)
+            return -1;
+
+        ptr    += written;
+        offset += written;
+        nbytes -= written;
+    }
+
+    return 0;
+}
+
+static int spill_read_all_(int fd, void* data, size_t nbytes, off_t offset)
+{
+    char* ptr = (char*) data;
+
+    while(nbytes)
+    {
+        ssize_t nread = pread(fd, ptr, nbytes, offset);
+        if(nread < 0 && errno == EINTR)
+            continue;
+        if(nread <= 0)
+            return -1;
+
+        ptr    += nread;
+        offset += nread;
+        nbytes -= nread;
+    }
+
+    return 0;
+}
+
+static void* spill_thread_(void* arg)
+{
+    Spill_stack* stk = (Spill_stack*) arg;
+    Spill_io* io = IO_;
+
+    pthread_mutex_lock(&io->mutex);
+
+    for(;;)
+    {
+        while(!io->q_len && !io->stop)
+            pthread_cond_wait(&io->wake, &io->mutex);
+
+        if(io->stop)
+            break;
+
+        Spill_req req = io->queue[io->q_head];
+
+        // Requests are processed in order, so segments below are already in file
+        Spill_seg seg = SEGS_[req.seg];
+        if(req.op == SPILL_WRITE)
+            seg.offset = req.seg ? SEGS_[req.seg - 1].offset + SEGS_[req.seg - 1].nbytes : 0;
+
+        pthread_mutex_unlock(&io->mutex);
+
+        uint64_t start = spill_time_ns_();
+        int io_err = 0;
+
+        if(req.op == SPILL_WRITE)
+        {
+            const void* out = seg.data;
+            seg.nbytes = SEG_BYTES;
+            seg.packed = false;
+
+#ifdef BUFFER_HASH
+            seg.hash = qhashfnv1_64(seg.data, SEG_BYTES);
+#endif
+            if(io->compress)
+            {
+                size_t packed_sz = io->compress(io->pack_buf, SEG_BYTES, seg.data, SEG_BYTES);
+                if(packed_sz && packed_sz < SEG_BYTES)
+                {
+                    out = io->pack_buf;
+                    seg.nbytes = packed_sz;
+                    seg.packed = true;
+                }
+            }
+
+            if(spill_write_all_(io->fd, out, seg.nbytes, seg.offset) != 0)
+                io_err |= Stack_err::BAD_BUF;
+        }
+        else
+        {
+            void* in = seg.packed ? (void*) io->pack_buf : (void*) req.buf;
+
+            if(spill_read_all_(io->fd, in, seg.nbytes, seg.offset) != 0)
+                io_err |= Stack_err::BAD_BUF;
+            else if(seg.packed && io->decompress(req.buf, SEG_BYTES, io->pack_buf, seg.nbytes) != SEG_BYTES)
+                seg.corrupted = true;
+#ifdef BUFFER_HASH
+            else if(seg.hash != qhashfnv1_64(req.buf, SEG_BYTES))
+                seg.corrupted = true;
+#endif
+        }
+
+        uint64_t elapsed = spill_time_ns_() - start;
+
+        pthread_mutex_lock(&io->mutex);
+
+        Spill_seg* cur = &SEGS_[req.seg];
+
+        if(req.op == SPILL_WRITE)
+        {
+            io->stats.spilled_bytes += seg.nbytes;
+            io->stats.spill_ns      += elapsed;
+            io->q_writes--;
+
+            Elem_t* buf = cur->data;
+
+            cur->offset = seg.offset;
+            cur->nbytes = seg.nbytes;
+            cur->hash   = seg.hash;
+            cur->packed = seg.packed;
+            cur->data   = nullptr;
+
+            if(io->nfree < io->free_cap)
+                io->free_bufs[io->nfree++] = buf;
+            else
+                free(buf);
+        }
+        else
+        {
+            io->stats.reloaded_bytes += seg.nbytes;
+            io->stats.reload_ns      += elapsed;
+
+            cur->data      = req.buf;
+            cur->corrupted = seg.corrupted;
+        }
+
+        __atomic_store_n(&io->io_err, io->io_err | io_err, __ATOMIC_RELAXED);
+
+        cur->pending--;
+        io->q_head = (io->q_head + 1) % io->q_cap;
+        io->q_len--;
+
+        pthread_cond_broadcast(&io->done);
+    }
+
+    pthread_mutex_unlock(&io->mutex);
+
+    return nullptr;
+}
+
+static Elem_t* spill_get_buf_(Spill_io* io)
+{
+    assert(io);
+
+    Elem_t* buf = nullptr;
+
+    pthread_mutex_lock(&io->mutex);
+    if(io->nfree)
+        buf = io->free_bufs[--io->nfree];
+    pthread_mutex_unlock(&io->mutex);
+
+    if(!buf)
+        buf = (Elem_t*) malloc(SEG_BYTES);
+
+    return buf;
+}
+
+static void spill_put_buf_(Spill_io* io, Elem_t* buf)
+{
+    assert(io);
+
+    pthread_mutex_lock(&io->mutex);
+    if(io->nfree < io->free_cap)
+    {
+        io->free_bufs[io->nfree++] = buf;
+        buf = nullptr;
+    }
+    pthread_mutex_unlock(&io->mutex);
+
+    free(buf);
+}
+
+static int spill_enqueue_(Spill_stack* stk, Spill_op op, size_t seg, Elem_t* buf)
+{
+    assert(stk && IO_);
+
+    if(op == SPILL_READ && !buf)
+        return -1;
+
+    Spill_io* io = IO_;
+    int ret = 0;
+
+    pthread_mutex_lock(&io->mutex);
+
+    if(io->q_len == io->q_cap)
+    {
+        size_t new_cap = io->q_cap ? io->q_cap * STACK_CAP_MULTPLR : STACK_MIN_CAP;
+        Spill_req* queue = (Spill_req*) malloc(new_cap * sizeof(Spill_req));
+
+        if(queue)
+        {
+            for(size_t iter = 0; iter < io->q_len; iter++)
+                queue[iter] = io->queue[(io->q_head + iter) % io->q_cap];
+
+            free(io->queue);
+            io->queue  = queue;
+            io->q_cap  = new_cap;
+            io->q_head = 0;
+        }
+        else
+        {
+            ret = -1;
+        }
+    }
+
+    if(ret == 0)
+    {
+        io->queue[(io->q_head + io->q_len) % io->q_cap] = {op, seg, buf};
+        io->q_len++;
+
+        if(op == SPILL_WRITE)
+            io->q_writes++;
+
+        SEGS_[seg].pending++;
+
+        pthread_cond_signal(&io->wake);
+    }
+
+    pthread_mutex_unlock(&io->mutex);
+
+    if(ret != 0)
+        free(buf);
+
+    return ret;
+}
+
+/// \brief Queues reload of segment to new buffer
+static int spill_reload_(Spill_stack* stk, size_t seg)
+{
+    assert(stk && IO_);
+
+    Elem_t* buf = spill_get_buf_(IO_);
+    if(!buf)
+        return -1;
+
+    return spill_enqueue_(stk, SPILL_READ, seg, buf);
+}
+
+/// \brief Waits for top segment to be reloaded (error is kept until stack is destroyed)
+static int spill_wait_top_(Spill_stack* stk)
+{
+    assert(stk && IO_ && NSEGS_);
+
+    Spill_io* io = IO_;
+    Spill_seg* top = &SEGS_[NSEGS_ - 1];
+
+    // Reload of top segment could not be queued by pop
+    if(stk->hot_beg == NSEGS_)
+    {
+        if(spill_reload_(stk, NSEGS_ - 1) != 0)
+            return Stack_err::BAD_ALLOC;
+
+        stk->hot_beg--;
+        spill_set_guards_(stk);
+    }
+
+    pthread_mutex_lock(&io->mutex);
+
+    if(top->pending || !top->data)
+    {
+        uint64_t start = spill_time_ns_();
+
+        while(top->pending || !top->data)
+            pthread_cond_wait(&io->done, &io->mutex);
+
+        io->stats.stall_ns += spill_time_ns_() - start;
+        io->stats.stalls++;
+    }
+
+    int err = io->io_err;
+    if(top->corrupted)
+        err |= Stack_err::BAD_BUF_HSH;
+
+    pthread_mutex_unlock(&io->mutex);
+
+    // Corrupted segment is reported by every operation, not only the first one
+    if(!err)
+        io->top_wait = false;
+
+    return err;
+}
+
+/// \brief Waits until queued writes and segments in memory fit in hot_segs, returns write error if any
+static int spill_wait_writes_(Spill_stack* stk)
+{
+    assert(stk && IO_);
+
+    Spill_io* io = IO_;
+
+    pthread_mutex_lock(&io->mutex);
+
+    if(io->q_writes + NSEGS_ - stk->hot_beg > stk->hot_segs && !io->io_err)
+    {
+        uint64_t start = spill_time_ns_();
+
+        while(io->q_writes + NSEGS_ - stk->hot_beg > stk->hot_segs && !io->io_err)
+            pthread_cond_wait(&io->done, &io->mutex);
+
+        io->stats.stall_ns += spill_time_ns_() - start;
+        io->stats.stalls++;
+    }
+
+    int err = io->io_err;
+
+    pthread_mutex_unlock(&io->mutex);
+
+    return err;
+}
+
+static void spill_set_guards_(Spill_stack* stk)
+{
+    assert(stk);
+
+#ifdef CANARY
+    stk->beg_can = DEFAULT_CANARY;
+    stk->end_can = DEFAULT_CANARY;
+#endif
+#ifdef STACK_HASH
+    stk->stk_hash = spill_hash_(stk);
+#endif
+}
+
+static uint64_t spill_time_ns_()
+{
+    timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+////////////////////////////////////////////////////////////////
+#ifdef DUMP
+static void spill_dump_lvl_(const Spill_stack* const stk, Stack_err err, Stack_dump_lvl level, const char msg[],
+                            const char func[], const char file[], int line)
+{
+    FILE* stream = dump_begin_(stk, "Spill_stack", err, level, msg, func, file, line);
+    if(!stream)
+        return;
+
+    if(!stk)
+    {
+        fprintf(stream, "    nullptr to stack\n");
+        fflush(stream);
+        return;
+    }
+
+    fprintf(stream, "    segments[%p]\n", SEGS_);
+    fprintf(stream, "    size          = %llu\n", SZ_);
+    fprintf(stream, "    segments      = %llu (in memory from %llu)\n", NSEGS_, stk->hot_beg);
+    fprintf(stream, "    top size      = %llu\n", TOP_SZ_);
+
+#ifdef CANARY
+    fprintf(stream, "     stack  begin = %llx\n", stk->beg_can);
+    fprintf(stream, "     stack  end   = %llx\n", stk->end_can);
+#endif
+#ifdef STACK_HASH
+    fprintf(stream, "     stack  hash  = %llx\n", stk->stk_hash);
+#endif
+
+    if(IO_ && IO_ != IO_POISON)
+    {
+        Spill_stats stats = {};
+        spill_stats(stk, &stats);
+
+        const double NS_IN_SEC = 1e9;
+        const double MB        = 1 << 20;
+
+        fprintf(stream, "    spilled       = %.1f MB (%.1f MB/s)\n", stats.spilled_bytes / MB,
+                stats.spill_ns ? stats.spilled_bytes / MB / (stats.spill_ns / NS_IN_SEC) : 0);
+        fprintf(stream, "    reloaded      = %.1f MB (%.1f MB/s)\n", stats.reloaded_bytes / MB,
+                stats.reload_ns ? stats.reloaded_bytes / MB / (stats.reload_ns / NS_IN_SEC) : 0);
+        fprintf(stream, "    stalls        = %llu (%.3f ms)\n", stats.stalls, stats.stall_ns / 1e6);
+    }
+
+    fflush(stream);
+}
+
+Stack_err spill_dump_(const Spill_stack* const stk, const char msg[],
+                      const char func[], const char file[], int line)
+{
+    assert(stk && msg && func && file && line);
+
+    Stack_err err = spill_verify_(stk);
+
+    spill_dump_lvl_(stk, err, Stack_dump_lvl::DETAILED, msg, func, file, line);
+
+    return err;
+}
+#endif // DUMP
@@ -0,0 +1,213 @@
+#include "include/stack_alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// Constants of <numaif.h> (libnuma is not required)
+const int MPOL_PREFERRED_ = 1;
+const int MPOL_F_NODE_    = 1 << 0;
+const int MPOL_F_ADDR_    = 1 << 1;
+
+/// Number of nodes in node mask passed to mbind
+const unsigned long MAX_NODES = 8 * sizeof(unsigned long);
+#endif // __linux__
+
+static bool stack_mem_default_(const Stack_alloc* alloc)
+{
+    return !alloc || (alloc->node < 0 && alloc->huge == HUGE_NONE);
+}
+
+/// \brief Size of pages backing buffer (transparent huge pages may fall back to regular ones)
+static size_t stack_mem_page_sz_(int huge_used)
+{
+    if(huge_used == HUGE_EXPLICIT)
+        return STACK_HUGE_PAGE_SZ;
+
+#ifdef __linux__
+    long page = sysconf(_SC_PAGESIZE);
+    if(page > 0)
+        return (size_t) page;
+#endif // __linux__
+
+    return 4096;
+}
+
+#ifdef __linux__
+static size_t stack_mem_map_sz_(size_t nbytes, int huge_used)
+{
+    size_t page = huge_used == HUGE_NONE ? (size_t) sysconf(_SC_PAGESIZE) : STACK_HUGE_PAGE_SZ;
+
+    return (nbytes + page - 1) / page * page;
+}
+
+/// \brief Sets preferred node of mapping, returns node or STACK_NODE_ANY if it is not set
+static int stack_mem_bind_(void* ptr, size_t map_sz, const Stack_alloc* alloc)
+{
+    assert(ptr && alloc);
+
+    if(alloc->node < 0 || (unsigned long) alloc->node >= MAX_NODES)
+        return STACK_NODE_ANY;
+
+    unsigned long nodemask = 1UL << alloc->node;
+    if(syscall(SYS_mbind, ptr, map_sz, MPOL_PREFERRED_, &nodemask, MAX_NODES + 1, 0) != 0)
+        return STACK_NODE_ANY;
+
+    return alloc->node;
+}
+
+static void* stack_mem_map_(size_t nbytes, Stack_alloc* alloc)
+{
+    assert(alloc);
+
+    int huge = nbytes >= alloc->huge_threshold ? alloc->huge : HUGE_NONE;
+    void* ptr = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    if(huge == HUGE_EXPLICIT)
+    {
+        ptr = mmap(nullptr, stack_mem_map_sz_(nbytes, HUGE_EXPLICIT), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if(ptr == MAP_FAILED)
+            huge = HUGE_THP;
+    }
+#else
+    if(huge == HUGE_EXPLICIT)
+        huge = HUGE_THP;
+#endif // MAP_HUGETLB
+
+    if(ptr == MAP_FAILED)
+    {
+        ptr = mmap(nullptr, stack_mem_map_sz_(nbytes, huge), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if(ptr == MAP_FAILED)
+            return nullptr;
+
+#ifdef MADV_HUGEPAGE
+        if(huge == HUGE_THP)
+            madvise(ptr, stack_mem_map_sz_(nbytes, huge), MADV_HUGEPAGE);
+#endif
+    }
+
+    // Policy is set before pages are touched, so they are placed on node at first touch
+    alloc->node_used = stack_mem_bind_(ptr, stack_mem_map_sz_(nbytes, huge), alloc);
+    alloc->huge_used = huge;
+
+    return ptr;
+}
+#endif // __linux__
+
+void* stack_mem_realloc(void* ptr, size_t old_bytes, size_t new_bytes, Stack_alloc* alloc)
+{
+    if(stack_mem_default_(alloc))
+        return realloc(ptr, new_bytes);
+
+#ifdef __linux__
+    int old_huge = alloc->huge_used;
+    int old_node = alloc->node_used;
+
+#ifdef MREMAP_MAYMOVE
+    int new_huge = new_bytes >= alloc->huge_threshold ? alloc->huge : HUGE_NONE;
+
+    // Regular and transparent huge pages are moved to resized mapping by kernel without copying
+    if(ptr && new_huge == old_huge && new_huge != HUGE_EXPLICIT)
+    {
+        size_t old_sz = stack_mem_map_sz_(old_bytes, old_huge);
+        size_t new_sz = stack_mem_map_sz_(new_bytes, new_huge);
+
+        void* new_ptr = old_sz == new_sz ? ptr : mremap(ptr, old_sz, new_sz, MREMAP_MAYMOVE);
+        if(new_ptr != MAP_FAILED)
+        {
+            // Policy is set again for pages added by growth before they are touched
+            if(new_sz > old_sz)
+                alloc->node_used = stack_mem_bind_(new_ptr, new_sz, alloc);
+
+            return new_ptr;
+        }
+    }
+#endif // MREMAP_MAYMOVE
+
+    void* new_ptr = stack_mem_map_(new_bytes, alloc);
+    if(!new_ptr)
+    {
+        alloc->huge_used = old_huge;
+        alloc->node_used = old_node;
+        return nullptr;
+    }
+
+    if(ptr)
+    {
+        memcpy(new_ptr, ptr, old_bytes < new_bytes ? old_bytes : new_bytes);
+        munmap(ptr, stack_mem_map_sz_(old_bytes, old_huge));
+    }
+
+    return new_ptr;
+#else
+    return realloc(ptr, new_bytes);
+#endif // __linux__
+}
+
+void stack_mem_free(void* ptr, size_t nbytes, const Stack_alloc* alloc)
+{
+    if(!ptr)
+        return;
+
+    if(stack_mem_default_(alloc))
+    {
+        free(ptr);
+        return;
+    }
+
+#ifdef __linux__
+    munmap(ptr, stack_mem_map_sz_(nbytes, alloc->huge_used));
+#else
+    free(ptr);
+#endif // __linux__
+}
+
+void stack_mem_prefault(void* ptr, size_t nbytes, const Stack_alloc* alloc)
+{
+    if(!ptr)
+        return;
+
+    size_t page = stack_mem_page_sz_(alloc ? alloc->huge_used : HUGE_NONE);
+
+    volatile char* bytes = (volatile char*) ptr;
+    for(size_t offset = 0; offset < nbytes; offset += page)
+        bytes[offset] = bytes[offset];
+
+    if(nbytes)
+        bytes[nbytes - 1] = bytes[nbytes - 1];
+}
+
+int stack_mem_local_node()
+{
+#ifdef __linux__
+    unsigned cpu  = 0;
+    unsigned node = 0;
+
+    if(syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+        return (int) node;
+#endif // __linux__
+
+    return STACK_NODE_ANY;
+}
+
+int stack_mem_node(const void* ptr)
+{
+#ifdef __linux__
+    int node = STACK_NODE_ANY;
+
+    if(ptr && syscall(SYS_get_mempolicy, &node, nullptr, 0, ptr, MPOL_F_NODE_ | MPOL_F_ADDR_) == 0)
+        return node;
+#endif // __linux__
+
+    return STACK_NODE_ANY;
+}
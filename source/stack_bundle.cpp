@@ -0,0 +1,538 @@
+#include "include/config.h"
+#include "include/Stack.h"
+#include "include/stack_bundle.h"
+#include "include/stack_hash.h"
+
+#ifndef __USE_MINGW_ANSI_STDIO
+#define __USE_MINGW_ANSI_STDIO 1
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+
+static bundle_mask_t bundle_mask_(const Stack_bundle* stk, bundle_mask_t mask);
+static void bundle_range_(const Stack_bundle* stk, bundle_mask_t mask, size_t* min, size_t* max);
+static void bundle_rows_(Stack_bundle* stk);
+static int bundle_resize_(Stack_bundle* stk, size_t new_capacity);
+static size_t bundle_buf_bytes_(size_t capacity, size_t lanes);
+static void bundle_set_guards_(Stack_bundle* stk);
+
+#ifdef DUMP
+static void bundle_dump_lvl_(const Stack_bundle* const stk, Stack_err err, Stack_dump_lvl level, const char msg[],
+                             const char func[], const char file[], int line);
+
+    #ifdef DUMP_ALL
+        #define DO_DUMP bundle_dump_lvl_(stk, (Stack_err) err, Stack_dump_lvl::BRIEF, __func__, func, file, line)
+    #else
+        #define DO_DUMP bundle_dump_lvl_(stk, (Stack_err) err, Stack_dump_lvl::ONLYERR, __func__, func, file, line)
+    #endif // DUMP_ALL
+#else
+    #define DO_DUMP
+#endif // DUMP
+
+#define ASSERT(condition, error)        \
+    do                                  \
+    {                                   \
+        if(STACK_UNLIKELY(!(condition)))\
+        {                               \
+            err |= error;               \
+            DO_DUMP;                    \
+            return (Stack_err) err;     \
+        }                               \
+    } while(0)                          \
+
+#define BUF_ (stk->buffer)
+#define LANES_ (stk->lanes)
+#define CAP_ (stk->capacity)
+#define SZ_(lane) (stk->size[lane])
+#define ROW_(row) (BUF_ + (row) * LANES_)
+
+////////////////////////////////////////////////////////////////
+#ifdef PROTECT
+static Elem_t* const BUNDLE_POISON = (Elem_t*) 0x000000000BAD;
+
+#ifdef CANARY
+    #define BEG_BUF_CAN_ (*(((guard_t*) BUF_) - 1))
+    #define END_BUF_CAN_ (*((guard_t*) (BUF_ + CAP_ * LANES_)))
+#endif // CANARY
+
+/// \brief Hash of fields chained member by member (padding after lockstep is not hashed)
+static guard_t bundle_hash_(const Stack_bundle* stk)
+{
+    assert(stk);
+
+    const guard_t PRIME = 0x100000001B3;
+
+    guard_t hash = qhashfnv1_64(&stk->buffer, sizeof(stk->buffer));
+    hash = (hash * PRIME) ^ qhashfnv1_64(&stk->lanes,    sizeof(stk->lanes));
+    hash = (hash * PRIME) ^ qhashfnv1_64(&stk->capacity, sizeof(stk->capacity));
+    hash = (hash * PRIME) ^ qhashfnv1_64(&stk->rows,     sizeof(stk->rows));
+    hash = (hash * PRIME) ^ qhashfnv1_64(&stk->lockstep, sizeof(stk->lockstep));
+    hash = (hash * PRIME) ^ qhashfnv1_64(stk->size,      sizeof(stk->size));
+
+    return hash;
+}
+
+Stack_err bundle_verify_(const Stack_bundle* const stk)
+{
+    int err = Stack_err::NOERR;
+
+    if(!stk)
+        return Stack_err::NULLPTR;
+
+    if(BUF_ == BUNDLE_POISON)
+        return Stack_err::DSTRCTED;
+
+    if(LANES_ == 0 || LANES_ > BUNDLE_MAX_LANES)
+        return Stack_err::BAD_ARG;
+
+    size_t min = 0;
+    size_t max = 0;
+    bundle_range_(stk, bundle_mask_(stk, BUNDLE_ALL), &min, &max);
+
+    if(max > CAP_)
+        return Stack_err::SZ_OVR_CAP;
+
+    if(!BUF_ && CAP_)
+        return Stack_err::BAD_BUF;
+
+    // Rows and lockstep flag are derived from lane sizes, mismatch means broken structure (not hash)
+    if(stk->rows != max || stk->lockstep != (min == max))
+        err |= Stack_err::BAD_BUF;
+
+#ifdef CANARY
+    if(stk->beg_can != DEFAULT_CANARY || stk->end_can != DEFAULT_CANARY)
+        err |= Stack_err::BAD_STK_CAN;
+
+    if(BUF_ && (BEG_BUF_CAN_ != DEFAULT_CANARY || END_BUF_CAN_ != DEFAULT_CANARY))
+        err |= Stack_err::BAD_BUF_CAN;
+#endif
+#ifdef STACK_HASH
+    if(stk->stk_hash != bundle_hash_(stk))
+        err |= Stack_err::BAD_STK_HSH;
+#endif
+#ifdef BUFFER_HASH
+    if(BUF_ && stk->buf_hash != qhashfnv1_64(BUF_, CAP_ * LANES_ * sizeof(Elem_t)))
+        err |= Stack_err::BAD_BUF_HSH;
+#endif
+
+    return (Stack_err) err;
+}
+#endif // PROTECT ////////////////////////////////////////////////
+
+Stack_err bundle_init_(Stack_bundle* stk, size_t lanes, size_t preset_cap
+              DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
+    ASSERT(stk, Stack_err::NULLPTR);
+
+    ASSERT(BUF_ != BUNDLE_POISON, Stack_err::DSTRCTED);
+
+    ASSERT(!BUF_, Stack_err::REINIT);
+#endif // PROTECT
+
+    ASSERT(0 < lanes && lanes <= BUNDLE_MAX_LANES, Stack_err::BAD_ARG);
+
+    BUF_   = nullptr;
+    LANES_ = lanes;
+    CAP_   = 0;
+    memset(stk->size, 0, sizeof(stk->size));
+    bundle_rows_(stk);
+
+    if(preset_cap)
+        ASSERT(bundle_resize_(stk, preset_cap) == 0, Stack_err::BAD_ALLOC);
+
+    bundle_set_guards_(stk);
+
+#ifdef PROTECT
+    err |= bundle_verify_(stk);
+    DO_DUMP;
+#endif // PROTECT
+
+    return (Stack_err) err;
+}
+
+Stack_err bundle_push_(Stack_bundle* stk, const Elem_t vals[], bundle_mask_t mask
+              DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
+    err = bundle_verify_(stk);
+    ASSERT(!err, err);
+#endif // PROTECT
+
+    ASSERT(vals, Stack_err::NULLPTR);
+
+    mask = bundle_mask_(stk, mask);
+
+    size_t min = 0;
+    size_t max = 0;
+    bundle_range_(stk, mask, &min, &max);
+
+    if(STACK_UNLIKELY(max == CAP_))
+        ASSERT(bundle_resize_(stk, CAP_ ? CAP_ * STACK_CAP_MULTPLR : STACK_MIN_CAP) == 0, Stack_err::BAD_ALLOC);
+
+    if(STACK_LIKELY(min == max))
+    {
+        // Lanes are in lockstep: vector is stored to one row
+        Elem_t* row = ROW_(max);
+
+        if(mask == bundle_mask_(stk, BUNDLE_ALL))
+        {
+            memcpy(row, vals, LANES_ * sizeof(Elem_t));
+
+            for(size_t lane = 0; lane < LANES_; lane++)
+                SZ_(lane)++;
+        }
+        else
+        {
+            for(size_t lane = 0; lane < LANES_; lane++)
+            {
+                if(mask >> lane & 1)
+                {
+                    row[lane] = vals[lane];
+                    SZ_(lane)++;
+                }
+            }
+        }
+    }
+    else
+    {
+        // Diverged lanes: every value is scattered to its own row
+        for(size_t lane = 0; lane < LANES_; lane++)
+        {
+            if(mask >> lane & 1)
+            {
+                ROW_(SZ_(lane))[lane] = vals[lane];
+                SZ_(lane)++;
+            }
+        }
+    }
+
+    bundle_rows_(stk);
+    bundle_set_guards_(stk);
+
+#ifdef PROTECT
+    err = bundle_verify_(stk);
+    DO_DUMP;
+#endif // PROTECT
+
+    return (Stack_err) err;
+}
+
+Stack_err bundle_pop_(Stack_bundle* stk, Elem_t vals[], bundle_mask_t mask
+             DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
+    err = bundle_verify_(stk);
+    ASSERT(!err, err);
+#endif // PROTECT
+
+    ASSERT(vals, Stack_err::NULLPTR);
+
+    mask = bundle_mask_(stk, mask);
+
+    size_t min = 0;
+    size_t max = 0;
+    bundle_range_(stk, mask, &min, &max);
+
+    ASSERT(!mask || min, Stack_err::POP_EMPT_STK);
+
+    if(STACK_LIKELY(min == max) && mask == bundle_mask_(stk, BUNDLE_ALL))
+    {
+        Elem_t* row = ROW_(max - 1);
+
+        memcpy(vals, row, LANES_ * sizeof(Elem_t));
+
+        for(size_t lane = 0; lane < LANES_; lane++)
+            SZ_(lane)--;
+
+#ifdef PROTECT
+        memset(row, BYTE_POISON, LANES_ * sizeof(Elem_t));
+#endif
+    }
+    else
+    {
+        for(size_t lane = 0; lane < LANES_; lane++)
+        {
+            if(mask >> lane & 1)
+            {
+                Elem_t* slot = &ROW_(--SZ_(lane))[lane];
+                vals[lane] = *slot;
+
+#ifdef PROTECT
+                memset(slot, BYTE_POISON, sizeof(Elem_t));
+#endif
+            }
+        }
+    }
+
+    bundle_rows_(stk);
+
+    if(STACK_UNLIKELY(stk->rows * STACK_CAP_MULTPLR * STACK_CAP_MULTPLR <= CAP_) && CAP_ > STACK_MIN_CAP)
+        ASSERT(bundle_resize_(stk, CAP_ / STACK_CAP_MULTPLR) == 0, Stack_err::BAD_ALLOC);
+
+    bundle_set_guards_(stk);
+
+#ifdef PROTECT
+    err = bundle_verify_(stk);
+    DO_DUMP;
+#endif // PROTECT
+
+    return (Stack_err) err;
+}
+
+Stack_err bundle_dstr_(Stack_bundle* stk
+              DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
+    err = bundle_verify_(stk);
+
+    ASSERT(stk, Stack_err::NULLPTR);
+
+    ASSERT(BUF_ != BUNDLE_POISON, Stack_err::DSTRCTED);
+
+    if(BUF_)
+    {
+#ifdef CANARY
+        BUF_ = (Elem_t*) &BEG_BUF_CAN_;
+#endif
+        memset(BUF_, BYTE_POISON, bundle_buf_bytes_(CAP_, LANES_));
+    }
+#endif // PROTECT
+
+    free(BUF_);
+
+#ifdef PROTECT
+    BUF_   = BUNDLE_POISON;
+    LANES_ = SIZE_POISON;
+    CAP_   = SIZE_POISON;
+
+#ifdef STACK_HASH
+    stk->stk_hash = SIZE_POISON;
+#endif
+#ifdef BUFFER_HASH
+    stk->buf_hash = SIZE_POISON;
+#endif
+#ifdef CANARY
+    stk->beg_can = (guard_t) SIZE_POISON;
+    stk->end_can = (guard_t) SIZE_POISON;
+#endif
+
+    DO_DUMP;
+#else
+    BUF_ = nullptr;
+    CAP_ = 0;
+    memset(stk->size, 0, sizeof(stk->size));
+    bundle_rows_(stk);
+#endif // PROTECT
+
+    return (Stack_err) err;
+}
+
+/// \brief Mask without lanes above stk->lanes
+static bundle_mask_t bundle_mask_(const Stack_bundle* stk, bundle_mask_t mask)
+{
+    assert(stk && LANES_ <= BUNDLE_MAX_LANES);
+
+    return mask & (bundle_mask_t) ((1ULL << LANES_) - 1);
+}
+
+/// \brief Minimal and maximal sizes of lanes selected by mask (both are 0 if mask is empty)
+static void bundle_range_(const Stack_bundle* stk, bundle_mask_t mask, size_t* min, size_t* max)
+{
+    assert(stk && min && max);
+
+    *min = SIZE_MAX;
+    *max = 0;
+
+    for(size_t lane = 0; lane < LANES_; lane++)
+    {
+        if(mask >> lane & 1)
+        {
+            *min = SZ_(lane) < *min ? SZ_(lane) : *min;
+            *max = SZ_(lane) > *max ? SZ_(lane) : *max;
+        }
+    }
+
+    if(!mask)
+        *min = 0;
+}
+
+/// \brief Updates maximal size of lanes and lockstep flag (used by inlined push and pop)
+static void bundle_rows_(Stack_bundle* stk)
+{
+    assert(stk);
+
+    size_t min = 0;
+    size_t max = 0;
+    bundle_range_(stk, bundle_mask_(stk, BUNDLE_ALL), &min, &max);
+
+    stk->rows     = max;
+    stk->lockstep = min == max;
+}
+
+/// \brief Size of buffer allocation in bytes (including canaries)
+static size_t bundle_buf_bytes_(size_t capacity, size_t lanes)
+{
+#ifdef CANARY
+    return capacity * lanes * sizeof(Elem_t) + 2 * sizeof(guard_t);
+#else
+    return capacity * lanes * sizeof(Elem_t);
+#endif
+}
+
+static int bundle_resize_(Stack_bundle* stk, size_t new_capacity)
+{
+    assert(stk);
+
+    if(new_capacity < STACK_MIN_CAP)
+        new_capacity = STACK_MIN_CAP;
+
+    // Rows keep their offsets, so lanes stay interleaved after realloc
+    char* buffer = (char*) BUF_;
+#ifdef CANARY
+    if(buffer)
+        buffer -= sizeof(guard_t);
+#endif
+
+    buffer = (char*) realloc(buffer, bundle_buf_bytes_(new_capacity, LANES_));
+    if(!buffer)
+        return -1;
+
+#ifdef CANARY
+    buffer += sizeof(guard_t);
+#endif
+
+    if(new_capacity > CAP_)
+        memset(buffer + CAP_ * LANES_ * sizeof(Elem_t), BYTE_POISON, (new_capacity - CAP_) * LANES_ * sizeof(Elem_t));
+
+    BUF_ = (Elem_t*) buffer;
+    CAP_ = new_capacity;
+
+#ifdef CANARY
+    BEG_BUF_CAN_ = DEFAULT_CANARY;
+    END_BUF_CAN_ = DEFAULT_CANARY;
+#endif
+
+    return 0;
+}
+
+static void bundle_set_guards_(Stack_bundle* stk)
+{
+    assert(stk);
+
+#ifdef CANARY
+    stk->beg_can = DEFAULT_CANARY;
+    stk->end_can = DEFAULT_CANARY;
+#endif
+#ifdef STACK_HASH
+    stk->stk_hash = bundle_hash_(stk);
+#endif
+#ifdef BUFFER_HASH
+    if(BUF_)
+        stk->buf_hash = qhashfnv1_64(BUF_, CAP_ * LANES_ * sizeof(Elem_t));
+#endif
+}
+
+////////////////////////////////////////////////////////////////
+#ifdef DUMP
+static void bundle_dump_lvl_(const Stack_bundle* const stk, Stack_err err, Stack_dump_lvl level, const char msg[],
+                             const char func[], const char file[], int line)
+{
+    FILE* stream = dump_begin_(stk, "Stack_bundle", err, level, msg, func, file, line);
+    if(!stream)
+        return;
+
+    if(!stk)
+    {
+        fprintf(stream, "    nullptr to bundle\n");
+        fflush(stream);
+        return;
+    }
+
+    fprintf(stream, "    buffer[%p]\n", BUF_);
+    fprintf(stream, "    lanes         = %llu\n", LANES_);
+    fprintf(stream, "    capacity      = %llu\n", CAP_);
+    fprintf(stream, "    rows          = %llu%s\n", stk->rows, stk->lockstep ? " (lockstep)" : "");
+
+#ifdef CANARY
+    fprintf(stream, "     stack  begin = %llx\n", stk->beg_can);
+    fprintf(stream, "     stack  end   = %llx\n", stk->end_can);
+#endif
+#ifdef STACK_HASH
+    fprintf(stream, "     stack  hash  = %llx\n", stk->stk_hash);
+#endif
+#ifdef BUFFER_HASH
+    fprintf(stream, "     buffer hash  = %llx\n", stk->buf_hash);
+#endif
+
+    if(BUF_ == BUNDLE_POISON || LANES_ == 0 || LANES_ > BUNDLE_MAX_LANES)
+    {
+        fflush(stream);
+        return;
+    }
+
+    fprintf(stream, "    size          =");
+    for(size_t lane = 0; lane < LANES_; lane++)
+        fprintf(stream, " %llu", SZ_(lane));
+    fprintf(stream, "\n");
+
+    if(!BUF_)
+    {
+        fflush(stream);
+        return;
+    }
+
+    size_t max = 0;
+    for(size_t lane = 0; lane < LANES_; lane++)
+        max = SZ_(lane) > max && SZ_(lane) <= CAP_ ? SZ_(lane) : max;
+
+    // Top rows, slots above size of lane are shown as '-'
+    fprintf(stream, "    {\n");
+
+    size_t row = max;
+    for(; row > 0 && max - row < DUMP_TAIL_ELEMS; row--)
+    {
+        fprintf(stream, "     #%llu:", row - 1);
+
+        for(size_t lane = 0; lane < LANES_; lane++)
+        {
+            fprintf(stream, " ");
+
+            if(row - 1 < SZ_(lane))
+                dump_elem_(stream, &ROW_(row - 1)[lane]);
+            else
+                fprintf(stream, "-");
+        }
+
+        fprintf(stream, "\n");
+    }
+
+    if(row)
+        fprintf(stream, "        ...  %llu rows below\n", row);
+
+    fprintf(stream, "    }\n");
+    fflush(stream);
+}
+
+Stack_err bundle_dump_(const Stack_bundle* const stk, const char msg[],
+                       const char func[], const char file[], int line)
+{
+    assert(stk && msg && func && file && line);
+
+    Stack_err err = bundle_verify_(stk);
+
+    bundle_dump_lvl_(stk, err, Stack_dump_lvl::DETAILED, msg, func, file, line);
+
+    return err;
+}
+#endif // DUMP
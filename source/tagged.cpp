@@ -0,0 +1,90 @@
+#include "include/config.h"
+#include "include/Stack.h"
+#include "include/dump.h"
+#include "include/tagged.h"
+
+#ifndef __USE_MINGW_ANSI_STDIO
+#define __USE_MINGW_ANSI_STDIO 1
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef DUMP
+    #ifdef DUMP_ALL
+        #define DO_DUMP dump_(stk, (Stack_err) err, Stack_dump_lvl::BRIEF, __func__, func, file, line)
+    #else
+        #define DO_DUMP dump_(stk, (Stack_err) err, Stack_dump_lvl::ONLYERR, __func__, func, file, line)
+    #endif // DUMP_ALL
+#else
+    #define DO_DUMP
+#endif // DUMP
+
+#define ASSERT(condition, error)        \
+    do                                  \
+    {                                   \
+        if(!(condition))                \
+        {                               \
+            err |= error;               \
+            DO_DUMP;                    \
+            return (Stack_err) err;     \
+        }                               \
+    } while(0)                          \
+
+Stack_err stack_pop_tagged_(Stack* stk, Tag_type type, Elem_t* elem
+              DUMP_ON(const char func[], const char file[], int line))
+{
+    int err = Stack_err::NOERR;
+
+#ifdef PROTECT
+    // Stack is verified once, before top element is read
+    err = stack_verify_(stk);
+    ASSERT(!err, err);
+#endif // PROTECT
+
+    // Empty stack and nullptr are reported by pop
+    if(stk && stk->size)
+        ASSERT(tag_type(stk->buffer[stk->size - 1]) == type, Stack_err::BAD_TYPE);
+
+#ifdef PROTECT
+    return stack_pop_unchecked_(stk, elem DUMP_ON(func, file, line));
+#else
+    return stack_pop_fast_(stk, elem DUMP_ON(func, file, line));
+#endif // PROTECT
+}
+
+size_t stack_format_tagged(char dst[], size_t dst_sz, const Elem_t* elem)
+{
+    assert(dst && elem);
+
+    int nbytes = 0;
+
+    switch(tag_type(*elem))
+    {
+        case TAG_NUM:
+            nbytes = snprintf(dst, dst_sz, "num  ");
+            if(nbytes > 0 && (size_t) nbytes < dst_sz)
+                nbytes += stack_format_double(dst + nbytes, dst_sz - nbytes, elem);
+            break;
+        case TAG_NIL:
+            nbytes = snprintf(dst, dst_sz, "nil");
+            break;
+        case TAG_BOOL:
+            nbytes = snprintf(dst, dst_sz, "bool %s", tag_as_bool(*elem) ? "true" : "false");
+            break;
+        case TAG_INT:
+            nbytes = snprintf(dst, dst_sz, "int  %d", tag_as_int(*elem));
+            break;
+        case TAG_PTR:
+            nbytes = snprintf(dst, dst_sz, "ptr  %p", tag_as_ptr(*elem));
+            break;
+        default:
+            nbytes = snprintf(dst, dst_sz, "BAD TAG %d", tag_type(*elem));
+            break;
+    }
+
+    if(nbytes < 0)
+        return 0;
+
+    return (size_t) nbytes < dst_sz ? (size_t) nbytes : dst_sz - 1;
+}
@@ -0,0 +1,73 @@
+/** \file
+ *  \brief Helpers for benchmarks of tools/ (timing and reporting)
+ *
+ *  Benchmarks are built together with all stack sources of source/, so they measure
+ *  configuration of config.h they are built with (it is printed first).
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "../include/config.h"
+
+/// \brief Monotonic time in nanoseconds
+inline uint64_t bench_time_ns()
+{
+    timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/// \brief Makes compiler assume that memory pointed by ptr is read (so computation of it is not optimized out)
+inline void bench_keep(const void* ptr)
+{
+    __asm__ volatile("" : : "g"(ptr) : "memory");
+}
+
+/// \brief Prints configuration options affecting performance
+inline void bench_config()
+{
+    printf("config:");
+#ifdef PROTECT
+    printf(" PROTECT");
+#endif
+#ifdef CANARY
+    printf(" CANARY");
+#endif
+#ifdef STACK_HASH
+    printf(" STACK_HASH");
+#endif
+#ifdef BUFFER_HASH
+    printf(" BUFFER_HASH");
+#endif
+#ifdef DUMP_ALL
+    printf(" DUMP_ALL");
+#endif
+#ifdef STACK_FIXED_CAP
+    printf(" STACK_FIXED_CAP");
+#endif
+#ifdef POISON_LAZY
+    printf(" POISON_LAZY");
+#endif
+#ifdef POISON_ASAN
+    printf(" POISON_ASAN");
+#endif
+#ifdef SNAPSHOT
+    printf(" SNAPSHOT");
+#endif
+#ifdef TRACE
+    printf(" TRACE");
+#endif
+    printf("\n");
+}
+
+/// \brief Prints time of one operation
+inline void bench_report(const char name[], uint64_t ns, uint64_t ops)
+{
+    printf("%-36s %10.2f ns/op\n", name, ops ? (double) ns / ops : 0.0);
+}
+
+#endif // BENCH_H
@@ -0,0 +1,171 @@
+/** \file
+ *  \brief Compares stack bundle with separate stacks, one per lane
+ *
+ *  Build together with all stack sources of source/.
+ *
+ *  Usage: bench_bundle [lanes] [steps]
+ *  Every step pushes or pops one value in each selected lane: all lanes in lockstep first, then
+ *  lanes selected by random masks (divergent sizes). The same steps are run on bundle and on
+ *  separate stacks, time per lane operation is reported.
+ */
+#include "../include/config.h"
+#include "../include/Stack.h"
+#include "../include/stack_bundle.h"
+#include "bench.h"
+
+#include <stdlib.h>
+
+#ifdef PROTECT
+/// \brief Protected operations verify whole buffer, so default workload is smaller
+const size_t DEFAULT_STEPS = 1 << 14;
+#else
+const size_t DEFAULT_STEPS = 1 << 22;
+#endif // PROTECT
+
+/// \brief Number of steps pushing before popping back (stacks stay shallow)
+const size_t BUNDLE_DEPTH = 64;
+
+static uint64_t xorshift_(uint64_t* seed)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+
+    return *seed;
+}
+
+/// \brief Lanes selected on step (all lanes if masks are not random)
+static bundle_mask_t step_mask_(uint64_t* seed, size_t lanes, bool divergent)
+{
+    bundle_mask_t all = ((bundle_mask_t) 1 << lanes) - 1;
+
+    return divergent ? (bundle_mask_t) xorshift_(seed) & all : all;
+}
+
+static uint64_t run_bundle_(size_t lanes, size_t steps, bool divergent, uint64_t* lane_ops, Elem_t* sum)
+{
+    Stack_bundle bundle = {};
+    bundle_init(&bundle, lanes, BUNDLE_DEPTH);
+
+    Elem_t vals[BUNDLE_MAX_LANES] = {};
+    uint64_t seed = 88172645463325252ULL;
+
+    uint64_t start = bench_time_ns();
+
+    // Lanes are pushed for BUNDLE_DEPTH steps and then popped for BUNDLE_DEPTH steps
+    for(size_t step = 0; step < steps; step++)
+    {
+        bundle_mask_t mask = step_mask_(&seed, lanes, divergent);
+
+        if(step % (2 * BUNDLE_DEPTH) < BUNDLE_DEPTH)
+        {
+            for(size_t lane = 0; lane < lanes; lane++)
+                vals[lane] = (Elem_t) step;
+
+            bundle_push(&bundle, vals, mask);
+        }
+        else
+        {
+            // Empty lanes are not selected, otherwise nothing is popped
+            for(size_t lane = 0; lane < lanes; lane++)
+                if(!bundle.size[lane])
+                    mask &= ~((bundle_mask_t) 1 << lane);
+
+            bundle_pop(&bundle, vals, mask);
+
+            for(size_t lane = 0; lane < lanes; lane++)
+                *sum += (mask >> lane) & 1 ? vals[lane] : 0;
+        }
+
+        *lane_ops += __builtin_popcount(mask);
+    }
+
+    uint64_t end = bench_time_ns();
+
+    bundle_dstr(&bundle);
+
+    return end - start;
+}
+
+static uint64_t run_scalar_(size_t lanes, size_t steps, bool divergent, uint64_t* lane_ops, Elem_t* sum)
+{
+    Stack stacks[BUNDLE_MAX_LANES] = {};
+    for(size_t lane = 0; lane < lanes; lane++)
+        stack_init(&stacks[lane], BUNDLE_DEPTH);
+
+    Elem_t elem = 0;
+    uint64_t seed = 88172645463325252ULL;
+
+    uint64_t start = bench_time_ns();
+
+    for(size_t step = 0; step < steps; step++)
+    {
+        bundle_mask_t mask = step_mask_(&seed, lanes, divergent);
+        bool push = step % (2 * BUNDLE_DEPTH) < BUNDLE_DEPTH;
+
+        for(size_t lane = 0; lane < lanes; lane++)
+        {
+            if(!((mask >> lane) & 1))
+                continue;
+
+            if(push)
+                stack_push(&stacks[lane], (Elem_t) step);
+            else if(stacks[lane].size)
+            {
+                stack_pop(&stacks[lane], &elem);
+                *sum += elem;
+            }
+            else
+                continue;
+
+            (*lane_ops)++;
+        }
+    }
+
+    uint64_t end = bench_time_ns();
+
+    for(size_t lane = 0; lane < lanes; lane++)
+        stack_dstr(&stacks[lane]);
+
+    return end - start;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t lanes = argc > 1 ? strtoull(argv[1], nullptr, 10) : BUNDLE_MAX_LANES;
+    size_t steps = argc > 2 ? strtoull(argv[2], nullptr, 10) : DEFAULT_STEPS;
+
+    if(!lanes || lanes > BUNDLE_MAX_LANES)
+    {
+        printf("number of lanes should be from 1 to %zu\n", BUNDLE_MAX_LANES);
+        return 1;
+    }
+
+    bench_config();
+
+    for(int divergent = 0; divergent < 2; divergent++)
+    {
+        uint64_t bundle_ops = 0;
+        uint64_t scalar_ops = 0;
+        Elem_t   bundle_sum = 0;
+        Elem_t   scalar_sum = 0;
+
+        uint64_t bundle_ns = run_bundle_(lanes, steps, divergent, &bundle_ops, &bundle_sum);
+        uint64_t scalar_ns = run_scalar_(lanes, steps, divergent, &scalar_ops, &scalar_sum);
+
+        bench_keep(&bundle_sum);
+        bench_keep(&scalar_sum);
+
+        printf("%s, %zu lanes:\n", divergent ? "random masks" : "lockstep", lanes);
+        bench_report("  bundle (per lane operation)",  bundle_ns, bundle_ops);
+        bench_report("  stacks (per lane operation)",  scalar_ns, scalar_ops);
+
+        if(bundle_sum != scalar_sum)
+        {
+            printf("results differ\n");
+            return 1;
+        }
+    }
+
+    return 0;
+}
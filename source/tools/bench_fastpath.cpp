@@ -0,0 +1,142 @@
+/** \file
+ *  \brief Measures per-operation cost of push, top and pop
+ *
+ *  Build together with all stack sources of source/, once with PROTECT in config.h
+ *  and once without it, to compare protected and unprotected builds.
+ *
+ *  Usage: bench_fastpath [depth] [rounds]
+ *  Every round pushes depth elements, reads top depth times and pops them back, first through
+ *  inline fast path (stack_push, stack_top, stack_pop) and then through out-of-line functions
+ *  (stack_push_, stack_top_, stack_pop_) the fast path falls back to. Capacity is reserved
+ *  beforehand, so no resize happens during measurement.
+ */
+#include "../include/config.h"
+#include "../include/Stack.h"
+#include "bench.h"
+
+#include <stdlib.h>
+
+#ifdef PROTECT
+/// \brief Protected operations verify whole buffer, so default workload is smaller
+const size_t DEFAULT_ROUNDS = 1000;
+#else
+const size_t DEFAULT_ROUNDS = 100000;
+#endif // PROTECT
+
+struct Fastpath_res
+{
+    uint64_t push_ns;
+    uint64_t top_ns;
+    uint64_t pop_ns;
+    Elem_t   sum;
+};
+
+static Fastpath_res run_inline_(Stack* stk, size_t depth, size_t rounds)
+{
+    Fastpath_res res = {};
+    Elem_t elem = 0;
+
+    for(size_t round = 0; round < rounds; round++)
+    {
+        uint64_t start = bench_time_ns();
+        for(size_t iter = 0; iter < depth; iter++)
+            stack_push(stk, (Elem_t) iter);
+
+        uint64_t pushed = bench_time_ns();
+        for(size_t iter = 0; iter < depth; iter++)
+        {
+            stack_top(stk, &elem);
+            res.sum += elem;
+        }
+
+        uint64_t topped = bench_time_ns();
+        for(size_t iter = 0; iter < depth; iter++)
+        {
+            stack_pop(stk, &elem);
+            res.sum += elem;
+        }
+
+        uint64_t popped = bench_time_ns();
+
+        res.push_ns += pushed - start;
+        res.top_ns  += topped - pushed;
+        res.pop_ns  += popped - topped;
+    }
+
+    return res;
+}
+
+static Fastpath_res run_outline_(Stack* stk, size_t depth, size_t rounds)
+{
+    Fastpath_res res = {};
+    Elem_t elem = 0;
+
+    for(size_t round = 0; round < rounds; round++)
+    {
+        uint64_t start = bench_time_ns();
+        for(size_t iter = 0; iter < depth; iter++)
+            stack_push_(stk, (Elem_t) iter DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__));
+
+        uint64_t pushed = bench_time_ns();
+        for(size_t iter = 0; iter < depth; iter++)
+        {
+            stack_top_(stk, &elem DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__));
+            res.sum += elem;
+        }
+
+        uint64_t topped = bench_time_ns();
+        for(size_t iter = 0; iter < depth; iter++)
+        {
+            stack_pop_(stk, &elem DUMP_ON(__PRETTY_FUNCTION__, __FILE__, __LINE__));
+            res.sum += elem;
+        }
+
+        uint64_t popped = bench_time_ns();
+
+        res.push_ns += pushed - start;
+        res.top_ns  += topped - pushed;
+        res.pop_ns  += popped - topped;
+    }
+
+    return res;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t depth  = argc > 1 ? strtoull(argv[1], nullptr, 10) : 64;
+    size_t rounds = argc > 2 ? strtoull(argv[2], nullptr, 10) : DEFAULT_ROUNDS;
+
+    bench_config();
+
+    Stack stk = {};
+    if(stack_init(&stk, depth) != Stack_err::NOERR)
+    {
+        printf("cannot initialize stack of %zu elements\n", depth);
+        return 1;
+    }
+
+    uint64_t ops = (uint64_t) depth * rounds;
+
+    Fastpath_res fast = run_inline_ (&stk, depth, rounds);
+    Fastpath_res slow = run_outline_(&stk, depth, rounds);
+
+    bench_keep(&fast.sum);
+    bench_keep(&slow.sum);
+
+    bench_report("push (inline)",      fast.push_ns, ops);
+    bench_report("top  (inline)",      fast.top_ns,  ops);
+    bench_report("pop  (inline)",      fast.pop_ns,  ops);
+    bench_report("push (out-of-line)", slow.push_ns, ops);
+    bench_report("top  (out-of-line)", slow.top_ns,  ops);
+    bench_report("pop  (out-of-line)", slow.pop_ns,  ops);
+
+    stack_dstr(&stk);
+
+    if(fast.sum != slow.sum)
+    {
+        printf("results differ\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,151 @@
+/** \file
+ *  \brief Measures latency distribution of push and pop for fixed and growing capacity
+ *
+ *  Build together with all stack sources of source/ with STACK_FIXED_CAP turned off
+ *  (fixed capacity is requested with Stack_alloc::fixed for one of stacks).
+ *
+ *  Usage: bench_fixed [depth] [rounds]
+ *  Every round pushes depth elements and pops them back. Growing stack resizes on the way up
+ *  and down, fixed one is allocated with capacity of depth once. Latency of every operation
+ *  is measured, median, tail percentiles and worst case are reported. Push to full fixed stack
+ *  is measured separately.
+ */
+#include "../include/config.h"
+#include "../include/Stack.h"
+#include "../include/stack_alloc.h"
+#include "bench.h"
+
+#include <stdlib.h>
+
+#ifdef STACK_FIXED_CAP
+#error "Turn off STACK_FIXED_CAP in config.h to compare fixed and growing capacity"
+#endif
+
+#ifdef PROTECT
+/// \brief Protected operations verify whole buffer, so default workload is smaller
+const size_t DEFAULT_DEPTH = 1 << 10;
+#else
+const size_t DEFAULT_DEPTH = 1 << 16;
+#endif // PROTECT
+
+/// \brief Number of pushes to full fixed stack
+const size_t FULL_PUSHES = 1000;
+
+static int cmp_lat_(const void* lhs, const void* rhs)
+{
+    uint64_t left  = *(const uint64_t*) lhs;
+    uint64_t right = *(const uint64_t*) rhs;
+
+    return (left > right) - (left < right);
+}
+
+/// \brief Sorts latencies and prints percentiles of them
+static void report_lat_(const char name[], uint64_t lat[], size_t nlat)
+{
+    qsort(lat, nlat, sizeof(uint64_t), &cmp_lat_);
+
+    printf("%-24s p50 %8llu  p99 %8llu  p99.9 %8llu  max %10llu ns\n", name,
+           (unsigned long long) lat[nlat / 2],
+           (unsigned long long) lat[nlat * 99 / 100],
+           (unsigned long long) lat[nlat * 999 / 1000],
+           (unsigned long long) lat[nlat - 1]);
+}
+
+static void run_stack_(const char name[], Stack* stk, size_t depth, size_t rounds,
+                       uint64_t push_lat[], uint64_t pop_lat[])
+{
+    Elem_t sum  = 0;
+    Elem_t elem = 0;
+    size_t nop  = 0;
+
+    for(size_t round = 0; round < rounds; round++)
+    {
+        for(size_t iter = 0; iter < depth; iter++)
+        {
+            uint64_t start = bench_time_ns();
+            stack_push(stk, (Elem_t) iter);
+            push_lat[nop + iter] = bench_time_ns() - start;
+        }
+
+        for(size_t iter = 0; iter < depth; iter++)
+        {
+            uint64_t start = bench_time_ns();
+            stack_pop(stk, &elem);
+            pop_lat[nop + iter] = bench_time_ns() - start;
+
+            sum += elem;
+        }
+
+        nop += depth;
+    }
+
+    bench_keep(&sum);
+
+    printf("%s:\n", name);
+    report_lat_("  push", push_lat, nop);
+    report_lat_("  pop",  pop_lat,  nop);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t depth  = argc > 1 ? strtoull(argv[1], nullptr, 10) : DEFAULT_DEPTH;
+    size_t rounds = argc > 2 ? strtoull(argv[2], nullptr, 10) : 16;
+
+    if(!depth || !rounds)
+    {
+        printf("depth and number of rounds should be positive\n");
+        return 1;
+    }
+
+    bench_config();
+
+    uint64_t* push_lat = (uint64_t*) calloc(depth * rounds, sizeof(uint64_t));
+    uint64_t* pop_lat  = (uint64_t*) calloc(depth * rounds, sizeof(uint64_t));
+    if(!push_lat || !pop_lat)
+    {
+        printf("cannot allocate %zu latencies\n", depth * rounds);
+        free(push_lat);
+        free(pop_lat);
+        return 1;
+    }
+
+    Stack growing = {};
+    stack_init(&growing, 0);
+    run_stack_("growing capacity", &growing, depth, rounds, push_lat, pop_lat);
+    stack_dstr(&growing);
+
+    Stack_alloc alloc = {};
+    alloc.fixed = true;
+
+    Stack fixed = {};
+    if(stack_init_alloc(&fixed, depth, &alloc) != Stack_err::NOERR)
+    {
+        printf("cannot initialize fixed stack of %zu elements\n", depth);
+        free(push_lat);
+        free(pop_lat);
+        return 1;
+    }
+
+    run_stack_("fixed capacity", &fixed, depth, rounds, push_lat, pop_lat);
+
+    // Fixed stack may be allocated with larger capacity, it is filled up to it
+    while(stack_push(&fixed, 0) == Stack_err::NOERR)
+        ;
+
+    size_t full = 0;
+    for(; full < FULL_PUSHES && full < depth * rounds; full++)
+    {
+        uint64_t start = bench_time_ns();
+        stack_push(&fixed, 0);
+        push_lat[full] = bench_time_ns() - start;
+    }
+
+    report_lat_("  push to full", push_lat, full);
+
+    stack_dstr(&fixed);
+
+    free(push_lat);
+    free(pop_lat);
+
+    return 0;
+}
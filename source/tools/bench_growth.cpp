@@ -0,0 +1,124 @@
+/** \file
+ *  \brief Measures cost of buffer growth for the poisoning strategy of config.h
+ *
+ *  Build together with all stack sources of source/ three times to compare strategies:
+ *  default config (eager BYTE_POISON fill), with POISON_LAZY and with POISON_ASAN
+ *  (the latter needs -fsanitize=address, which slows down the rest of the code too).
+ *  Protection verifies whole buffer on every operation and DUMP_ALL dumps it, turn them off
+ *  to see cost of poisoning itself.
+ *
+ *  Usage: bench_growth [elements] [pushes]
+ *  Stack is grown from empty to elements by pushes and popped back. Then stack is
+ *  initialized with preset capacity of elements and only few pushes are done, so
+ *  eager fill of never used slots is seen. Time and minor page faults of every phase are reported.
+ */
+#include "../include/config.h"
+#include "../include/Stack.h"
+#include "bench.h"
+
+#include <stdlib.h>
+#include <sys/resource.h>
+
+// Without sanitizer annotations of POISON_ASAN do nothing (gcc defines macro, clang has feature)
+#if defined(__SANITIZE_ADDRESS__)
+#define BENCH_ASAN
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define BENCH_ASAN
+#endif
+#endif
+
+#if defined(POISON_ASAN) && !defined(BENCH_ASAN)
+#error "Build with -fsanitize=address to measure POISON_ASAN"
+#endif
+
+#ifdef PROTECT
+/// \brief Protected operations verify whole buffer, so default workload is smaller
+const size_t DEFAULT_ELEMS = 1 << 14;
+#else
+const size_t DEFAULT_ELEMS = 1 << 24;
+#endif // PROTECT
+
+/// \brief Minor page faults of process so far
+static long bench_faults_()
+{
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+
+    return usage.ru_minflt;
+}
+
+/// \brief Prints time of one operation and page faults of phase
+static void report_phase_(const char name[], uint64_t ns, uint64_t ops, long faults)
+{
+    printf("%-36s %10.2f ns/op %10ld faults\n", name, ops ? (double) ns / ops : 0.0, faults);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t nelems  = argc > 1 ? strtoull(argv[1], nullptr, 10) : DEFAULT_ELEMS;
+    size_t npushes = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1000;
+
+    if(!nelems || npushes > nelems)
+    {
+        printf("number of elements should be positive and not less than number of pushes\n");
+        return 1;
+    }
+
+    bench_config();
+
+    Elem_t sum  = 0;
+    Elem_t elem = 0;
+
+    // Growth from empty stack, every resize fills new free slots with eager poisoning
+    Stack grow = {};
+    stack_init(&grow, 0);
+
+    long     faults = bench_faults_();
+    uint64_t start  = bench_time_ns();
+    for(size_t iter = 0; iter < nelems; iter++)
+        stack_push(&grow, (Elem_t) iter);
+    uint64_t grown  = bench_time_ns();
+    long     grow_faults = bench_faults_() - faults;
+
+    for(size_t iter = 0; iter < nelems; iter++)
+    {
+        stack_pop(&grow, &elem);
+        sum += elem;
+    }
+    uint64_t popped = bench_time_ns();
+    long     pop_faults = bench_faults_() - faults - grow_faults;
+
+    stack_dstr(&grow);
+
+    report_phase_("push with growth", grown - start, nelems, grow_faults);
+    report_phase_("pop back to empty", popped - grown, nelems, pop_faults);
+
+    // Preset capacity, only first pushes use it
+    Stack preset = {};
+
+    faults = bench_faults_();
+    start  = bench_time_ns();
+    if(stack_init(&preset, (ssize_t) nelems) != Stack_err::NOERR)
+    {
+        printf("cannot initialize stack of %zu elements\n", nelems);
+        return 1;
+    }
+    uint64_t inited = bench_time_ns();
+    long     init_faults = bench_faults_() - faults;
+
+    for(size_t iter = 0; iter < npushes; iter++)
+        stack_push(&preset, (Elem_t) iter);
+    uint64_t pushed = bench_time_ns();
+    long     push_faults = bench_faults_() - faults - init_faults;
+
+    stack_dstr(&preset);
+
+    bench_keep(&sum);
+
+    // Init is reported per slot of preset capacity, as fill of it is linear in capacity
+    report_phase_("init with preset capacity (per slot)", inited - start, nelems, init_faults);
+    report_phase_("push after preset capacity", pushed - inited, npushes, push_faults);
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+/** \file
+ *  \brief Measures push and pop over large arrays of stacks
+ *
+ *  Build together with all stack sources of source/ (DUMP_ALL dumps every operation,
+ *  turn it off to see memory effects with protection).
+ *
+ *  Usage: bench_layout [operations]
+ *  Random stacks of array are pushed and popped. Array of Stack (one cache line per stack)
+ *  is compared with array of stacks followed by a line of cold fields read on every operation,
+ *  as if cold fields were kept in stack and covered by its hash. Array sizes range from
+ *  fitting in cache to far exceeding it.
+ */
+#include "../include/config.h"
+#include "../include/Stack.h"
+#include "bench.h"
+
+#include <stdlib.h>
+
+#ifdef PROTECT
+const size_t DEFAULT_OPS = 1 << 20;
+#else
+const size_t DEFAULT_OPS = 1 << 22;
+#endif // PROTECT
+
+/// \brief Stack with cold line next to it (layout with cold fields kept in stack)
+struct alignas(STACK_LINE_SZ) Wide_stack
+{
+                Stack stk;
+                char  cold[STACK_LINE_SZ] = {};
+};
+
+/// \brief Depth stacks are kept at, so their buffers are never resized
+const size_t LAYOUT_DEPTH = 4;
+
+static uint64_t xorshift_(uint64_t* seed)
+{
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+
+    return *seed;
+}
+
+/// \brief Runs random pushes and pops on stacks placed with stride bytes, reads cold line if it is given
+static uint64_t run_array_(char* base, size_t stride, size_t cold_offset, size_t nstacks, size_t nops)
+{
+    uint64_t seed = 88172645463325252ULL;
+    Elem_t   sum  = 0;
+    Elem_t   elem = 0;
+
+    uint64_t start = bench_time_ns();
+
+    for(size_t iter = 0; iter < nops; iter++)
+    {
+        uint64_t rand = xorshift_(&seed);
+        char* item = base + (rand % nstacks) * stride;
+        Stack* stk = (Stack*) item;
+
+        if(cold_offset)
+            sum += item[cold_offset];
+
+        if(stk->size < LAYOUT_DEPTH && (rand >> 40) % 2)
+            stack_push(stk, (Elem_t) iter);
+        else if(stk->size)
+        {
+            stack_pop(stk, &elem);
+            sum += elem;
+        }
+    }
+
+    uint64_t end = bench_time_ns();
+
+    bench_keep(&sum);
+
+    return end - start;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t nops = argc > 1 ? strtoull(argv[1], nullptr, 10) : DEFAULT_OPS;
+
+    bench_config();
+    printf("sizeof(Stack) = %zu, sizeof(Wide_stack) = %zu\n", sizeof(Stack), sizeof(Wide_stack));
+
+    const size_t SIZES[] = {1 << 8, 1 << 12, 1 << 16, 1 << 18};
+
+    for(size_t nstacks : SIZES)
+    {
+        Stack*      stacks = new Stack[nstacks];
+        Wide_stack* wide   = new Wide_stack[nstacks];
+
+        for(size_t iter = 0; iter < nstacks; iter++)
+        {
+            stack_init(&stacks[iter], LAYOUT_DEPTH);
+            stack_init(&wide[iter].stk, LAYOUT_DEPTH);
+        }
+
+        uint64_t narrow_ns = run_array_((char*) stacks, sizeof(Stack), 0, nstacks, nops);
+        uint64_t wide_ns   = run_array_((char*) wide, sizeof(Wide_stack), offsetof(Wide_stack, cold), nstacks, nops);
+
+        char name[64] = "";
+
+        snprintf(name, sizeof(name), "%zu stacks, one line", nstacks);
+        bench_report(name, narrow_ns, nops);
+        snprintf(name, sizeof(name), "%zu stacks, two lines", nstacks);
+        bench_report(name, wide_ns, nops);
+
+        for(size_t iter = 0; iter < nstacks; iter++)
+        {
+            stack_dstr(&stacks[iter]);
+            stack_dstr(&wide[iter].stk);
+        }
+
+        delete[] stacks;
+        delete[] wide;
+    }
+
+    return 0;
+}
@@ -0,0 +1,201 @@
+/** \file
+ *  \brief Measures throughput and TLB misses of deep stack for every buffer placement
+ *
+ *  Build together with all stack sources of source/ with PROTECT turned off (buffer
+ *  verification is linear in capacity, it hides memory effects on deep stacks).
+ *
+ *  Usage: bench_numa [elements] [peeks]
+ *  For default allocation, regular pages bound to local node, transparent and explicit huge
+ *  pages stack is filled up to elements, then read at random depths and popped back. Growth
+ *  from empty stack is measured separately (mapped buffers are resized with mremap). Data TLB
+ *  misses of random reads are counted with perf events if they are available.
+ */
+#include "../include/config.h"
+#include "../include/Stack.h"
+#include "../include/stack_alloc.h"
+#include "bench.h"
+
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif // __linux__
+
+#ifdef PROTECT
+#error "Turn off PROTECT in config.h to measure placement (otherwise every operation verifies whole buffer)"
+#endif
+
+/// \brief Opens counter of data TLB read misses of calling thread, returns -1 if it is not available
+static int tlb_open_()
+{
+#ifdef __linux__
+    perf_event_attr attr = {};
+    attr.type           = PERF_TYPE_HW_CACHE;
+    attr.size           = sizeof(attr);
+    attr.config         = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled       = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif // __linux__
+}
+
+static void tlb_start_(int fd)
+{
+#ifdef __linux__
+    if(fd >= 0)
+    {
+        ioctl(fd, PERF_EVENT_IOC_RESET,  0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif // __linux__
+}
+
+static long long tlb_stop_(int fd)
+{
+    long long misses = -1;
+
+#ifdef __linux__
+    if(fd >= 0)
+    {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+
+        if(read(fd, &misses, sizeof(misses)) != sizeof(misses))
+            misses = -1;
+    }
+#endif // __linux__
+
+    return misses;
+}
+
+struct Numa_mode
+{
+    const char* name;
+    bool        deflt;
+    Stack_alloc alloc;
+};
+
+static void run_mode_(const Numa_mode* mode, size_t nelems, size_t npeeks, int tlb_fd)
+{
+    Stack_alloc alloc = mode->alloc;
+    const Stack_alloc* alloc_ptr = mode->deflt ? nullptr : &alloc;
+
+    Elem_t sum = 0;
+    Elem_t elem = 0;
+
+    Stack stk = {};
+    if(stack_init_alloc(&stk, nelems, alloc_ptr) != Stack_err::NOERR)
+    {
+        printf("%s: cannot initialize stack\n", mode->name);
+        return;
+    }
+
+    uint64_t start = bench_time_ns();
+    for(size_t iter = 0; iter < nelems; iter++)
+        stack_push(&stk, (Elem_t) iter);
+    uint64_t filled = bench_time_ns();
+
+    // Depths are generated with xorshift, so reads do not follow any pattern
+    uint64_t seed = 88172645463325252ULL;
+
+    tlb_start_(tlb_fd);
+    uint64_t peek_start = bench_time_ns();
+    for(size_t iter = 0; iter < npeeks; iter++)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+
+        stack_peek(&stk, seed % nelems, &elem);
+        sum += elem;
+    }
+    uint64_t peek_end = bench_time_ns();
+    long long misses = tlb_stop_(tlb_fd);
+
+    for(size_t iter = 0; iter < nelems; iter++)
+    {
+        stack_pop(&stk, &elem);
+        sum += elem;
+    }
+    uint64_t popped = bench_time_ns();
+
+    int node = stack_mem_node(stk.buffer);
+    int huge_used = stk.info->alloc.huge_used;
+
+    stack_dstr(&stk);
+
+    // Growth from empty stack, buffer is resized on the way
+    Stack grow = {};
+    stack_init_alloc(&grow, 0, alloc_ptr);
+
+    uint64_t grow_start = bench_time_ns();
+    for(size_t iter = 0; iter < nelems; iter++)
+        stack_push(&grow, (Elem_t) iter);
+    uint64_t grow_end = bench_time_ns();
+
+    stack_dstr(&grow);
+
+    bench_keep(&sum);
+
+    printf("%s: node %d, %s pages\n", mode->name, node,
+           huge_used == HUGE_EXPLICIT ? "explicit huge" : huge_used == HUGE_THP ? "transparent huge" : "regular");
+
+    bench_report("  push", filled - start, nelems);
+    bench_report("  random peek", peek_end - peek_start, npeeks);
+    bench_report("  pop", popped - peek_end, nelems);
+    bench_report("  push with growth", grow_end - grow_start, nelems);
+
+    if(misses >= 0)
+        printf("  dTLB misses per peek                 %10.3f\n", (double) misses / npeeks);
+    else
+        printf("  dTLB misses per peek                        n/a\n");
+}
+
+int main(int argc, char* argv[])
+{
+    size_t nelems = argc > 1 ? strtoull(argv[1], nullptr, 10) : (size_t) 1 << 24;
+    size_t npeeks = argc > 2 ? strtoull(argv[2], nullptr, 10) : (size_t) 1 << 24;
+
+    if(!nelems)
+    {
+        printf("number of elements should be positive\n");
+        return 1;
+    }
+
+    bench_config();
+
+    Numa_mode modes[4] = {};
+
+    modes[0].name  = "default allocation";
+    modes[0].deflt = true;
+
+    modes[1].name = "regular pages, local node";
+    modes[1].alloc.node = STACK_NODE_LOCAL;
+
+    modes[2].name = "transparent huge pages, local node";
+    modes[2].alloc.node = STACK_NODE_LOCAL;
+    modes[2].alloc.huge = HUGE_THP;
+
+    modes[3].name = "explicit huge pages, local node";
+    modes[3].alloc.node = STACK_NODE_LOCAL;
+    modes[3].alloc.huge = HUGE_EXPLICIT;
+
+    int tlb_fd = tlb_open_();
+
+    for(int mode = 0; mode < 4; mode++)
+        run_mode_(&modes[mode], nelems, npeeks, tlb_fd);
+
+#ifdef __linux__
+    if(tlb_fd >= 0)
+        close(tlb_fd);
+#endif // __linux__
+
+    return 0;
+}
@@ -0,0 +1,333 @@
+/** \file
+ *  \brief Compares NaN-boxed tagged values with values boxed on heap on interpreter-style loop
+ *
+ *  Build together with all stack sources of source/.
+ *
+ *  Usage: bench_tagged [iterations]
+ *  Both interpreters run the same bytecode (loop adding i * 0.5 to accumulator) on operand
+ *  stack of Elem_t: tagged one keeps values in slots, boxed one keeps pointers to values
+ *  allocated on heap (loads copy value, consuming instructions free it).
+ */
+#include "../include/config.h"
+#include "../include/Stack.h"
+#include "../include/tagged.h"
+#include "bench.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+enum Op
+{
+    OP_LOAD,      ///< push local
+    OP_STORE,     ///< pop to local
+    OP_PUSH_INT,
+    OP_PUSH_NUM,
+    OP_ADD,
+    OP_MUL,
+    OP_LT,        ///< pushes boolean
+    OP_JMP_IFNOT, ///< pops boolean
+    OP_JMP,
+    OP_HALT,
+};
+
+struct Instr
+{
+    Op     op;
+    int    arg;
+    double num;
+};
+
+const int LOCALS = 2;
+
+/// \brief Program: i = 0, acc = 0.0; while(i < n) { acc = acc + i * 0.5; i = i + 1; }
+static void make_program_(Instr prog[], int n)
+{
+    const Instr code[] =
+    {
+        {OP_LOAD,      0,  0  },
+        {OP_PUSH_INT,  n,  0  },
+        {OP_LT,        0,  0  },
+        {OP_JMP_IFNOT, 15, 0  },
+        {OP_LOAD,      1,  0  },
+        {OP_LOAD,      0,  0  },
+        {OP_PUSH_NUM,  0,  0.5},
+        {OP_MUL,       0,  0  },
+        {OP_ADD,       0,  0  },
+        {OP_STORE,     1,  0  },
+        {OP_LOAD,      0,  0  },
+        {OP_PUSH_INT,  1,  0  },
+        {OP_ADD,       0,  0  },
+        {OP_STORE,     0,  0  },
+        {OP_JMP,       0,  0  },
+        {OP_HALT,      0,  0  },
+    };
+
+    memcpy(prog, code, sizeof(code));
+}
+
+const int PROG_LEN = 16;
+
+//////////////////////////////////////////////////////////////////////////////
+
+static Elem_t tagged_arith_(Op op, Elem_t lhs, Elem_t rhs)
+{
+    if(tag_type(lhs) == TAG_INT && tag_type(rhs) == TAG_INT)
+    {
+        int32_t left  = tag_as_int(lhs);
+        int32_t right = tag_as_int(rhs);
+
+        return tag_int(op == OP_ADD ? left + right : left * right);
+    }
+
+    double left  = tag_type(lhs) == TAG_INT ? tag_as_int(lhs) : tag_as_num(lhs);
+    double right = tag_type(rhs) == TAG_INT ? tag_as_int(rhs) : tag_as_num(rhs);
+
+    return tag_num(op == OP_ADD ? left + right : left * right);
+}
+
+/// \brief Runs program with tagged values, returns number of executed instructions
+static uint64_t run_tagged_(const Instr prog[], double* result)
+{
+    Stack stk = {};
+    stack_init(&stk, 0);
+
+    Elem_t locals[LOCALS] = {tag_int(0), tag_num(0)};
+    uint64_t executed = 0;
+
+    for(int pc = 0; prog[pc].op != OP_HALT; executed++)
+    {
+        const Instr* instr = &prog[pc++];
+        Elem_t lhs = 0;
+        Elem_t rhs = 0;
+        bool cond = false;
+
+        switch(instr->op)
+        {
+            case OP_LOAD:
+                stack_push(&stk, locals[instr->arg]);
+                break;
+            case OP_STORE:
+                stack_pop(&stk, &locals[instr->arg]);
+                break;
+            case OP_PUSH_INT:
+                stack_push_int(&stk, instr->arg);
+                break;
+            case OP_PUSH_NUM:
+                stack_push_num(&stk, instr->num);
+                break;
+            case OP_ADD:
+            case OP_MUL:
+                stack_pop(&stk, &rhs);
+                stack_pop(&stk, &lhs);
+                stack_push(&stk, tagged_arith_(instr->op, lhs, rhs));
+                break;
+            case OP_LT:
+            {
+                int32_t right = 0;
+                int32_t left  = 0;
+                stack_pop_int(&stk, &right);
+                stack_pop_int(&stk, &left);
+                stack_push_bool(&stk, left < right);
+                break;
+            }
+            case OP_JMP_IFNOT:
+                stack_pop_bool(&stk, &cond);
+                if(!cond)
+                    pc = instr->arg;
+                break;
+            case OP_JMP:
+                pc = instr->arg;
+                break;
+            case OP_HALT:
+            default:
+                break;
+        }
+    }
+
+    *result = tag_as_num(locals[1]);
+    stack_dstr(&stk);
+
+    return executed;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+/// \brief Value boxed on heap, its pointer is kept in stack slot
+struct Box
+{
+    Tag_type type;
+    union
+    {
+        double  num;
+        int32_t num_int;
+        bool    flag;
+    };
+};
+
+static Elem_t box_new_(Tag_type type, double num, int32_t num_int, bool flag)
+{
+    Box* box = (Box*) malloc(sizeof(Box));
+    box->type = type;
+
+    if(type == TAG_NUM)
+        box->num = num;
+    else if(type == TAG_INT)
+        box->num_int = num_int;
+    else
+        box->flag = flag;
+
+    Elem_t elem = 0;
+    memcpy(&elem, &box, sizeof(Box*));
+
+    return elem;
+}
+
+static Box* box_of_(Elem_t elem)
+{
+    Box* box = nullptr;
+    memcpy(&box, &elem, sizeof(Box*));
+
+    return box;
+}
+
+static Elem_t box_copy_(Elem_t elem)
+{
+    Box* box = (Box*) malloc(sizeof(Box));
+    *box = *box_of_(elem);
+
+    memcpy(&elem, &box, sizeof(Box*));
+
+    return elem;
+}
+
+static double box_as_num_(const Box* box)
+{
+    return box->type == TAG_INT ? box->num_int : box->num;
+}
+
+/// \brief Runs program with boxed values, returns number of executed instructions
+static uint64_t run_boxed_(const Instr prog[], double* result)
+{
+    Stack stk = {};
+    stack_init(&stk, 0);
+
+    Elem_t locals[LOCALS] = {box_new_(TAG_INT, 0, 0, false), box_new_(TAG_NUM, 0, 0, false)};
+    uint64_t executed = 0;
+
+    for(int pc = 0; prog[pc].op != OP_HALT; executed++)
+    {
+        const Instr* instr = &prog[pc++];
+        Elem_t lhs = 0;
+        Elem_t rhs = 0;
+
+        switch(instr->op)
+        {
+            case OP_LOAD:
+                stack_push(&stk, box_copy_(locals[instr->arg]));
+                break;
+            case OP_STORE:
+                free(box_of_(locals[instr->arg]));
+                stack_pop(&stk, &locals[instr->arg]);
+                break;
+            case OP_PUSH_INT:
+                stack_push(&stk, box_new_(TAG_INT, 0, instr->arg, false));
+                break;
+            case OP_PUSH_NUM:
+                stack_push(&stk, box_new_(TAG_NUM, instr->num, 0, false));
+                break;
+            case OP_ADD:
+            case OP_MUL:
+            {
+                stack_pop(&stk, &rhs);
+                stack_pop(&stk, &lhs);
+
+                Box* left  = box_of_(lhs);
+                Box* right = box_of_(rhs);
+
+                if(left->type == TAG_INT && right->type == TAG_INT)
+                    stack_push(&stk, box_new_(TAG_INT, 0, instr->op == OP_ADD ? left->num_int + right->num_int
+                                                                               : left->num_int * right->num_int, false));
+                else
+                    stack_push(&stk, box_new_(TAG_NUM, instr->op == OP_ADD ? box_as_num_(left) + box_as_num_(right)
+                                                                           : box_as_num_(left) * box_as_num_(right),
+                                              0, false));
+                free(left);
+                free(right);
+                break;
+            }
+            case OP_LT:
+            {
+                stack_pop(&stk, &rhs);
+                stack_pop(&stk, &lhs);
+
+                Box* left  = box_of_(lhs);
+                Box* right = box_of_(rhs);
+
+                stack_push(&stk, box_new_(TAG_BOOL, 0, 0, left->num_int < right->num_int));
+                free(left);
+                free(right);
+                break;
+            }
+            case OP_JMP_IFNOT:
+            {
+                stack_pop(&stk, &lhs);
+
+                Box* cond = box_of_(lhs);
+                if(!cond->flag)
+                    pc = instr->arg;
+                free(cond);
+                break;
+            }
+            case OP_JMP:
+                pc = instr->arg;
+                break;
+            case OP_HALT:
+            default:
+                break;
+        }
+    }
+
+    *result = box_of_(locals[1])->num;
+
+    for(int local = 0; local < LOCALS; local++)
+        free(box_of_(locals[local]));
+    stack_dstr(&stk);
+
+    return executed;
+}
+
+int main(int argc, char* argv[])
+{
+    int iters = argc > 1 ? atoi(argv[1]) : 10000000;
+
+    Instr prog[PROG_LEN] = {};
+    make_program_(prog, iters);
+
+    bench_config();
+
+    double tagged_res = 0;
+    double boxed_res  = 0;
+
+    uint64_t start  = bench_time_ns();
+    uint64_t tagged = run_tagged_(prog, &tagged_res);
+    uint64_t middle = bench_time_ns();
+    uint64_t boxed  = run_boxed_(prog, &boxed_res);
+    uint64_t end    = bench_time_ns();
+
+    bench_keep(&tagged_res);
+    bench_keep(&boxed_res);
+
+    bench_report("NaN-boxed (per instruction)", middle - start, tagged);
+    bench_report("heap-boxed (per instruction)", end - middle, boxed);
+
+    if(tagged_res != boxed_res)
+    {
+        printf("results differ: %g and %g\n", tagged_res, boxed_res);
+        return 1;
+    }
+
+    printf("result %g, heap-boxed / NaN-boxed = %.2f\n", tagged_res,
+           (double) (end - middle) / (middle - start ? middle - start : 1));
+
+    return 0;
+}
@@ -0,0 +1,281 @@
+/** \file
+ *  \brief Replays trace recorded with TRACE against current configuration of stack
+ *
+ *  Build together with all stack sources of source/ (with config.h to be compared),
+ *  TRACE should be turned off.
+ *
+ *  Usage: replay <trace file>
+ *  Operations are executed in order of their timestamps, throughput and latency of
+ *  every operation type are reported.
+ */
+#include "../include/config.h"
+#include "../include/Stack.h"
+#include "../include/trace.h"
+
+#ifndef __USE_MINGW_ANSI_STDIO
+#define __USE_MINGW_ANSI_STDIO 1
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef TRACE
+#error "Turn off TRACE in config.h to replay trace (otherwise replay is traced too)"
+#endif
+
+/// \brief Number of latency histogram buckets (bucket i counts latencies in [2^(i-1), 2^i) ns)
+const int LAT_BUCKETS = 64;
+
+/// \brief Record with its position in trace (for stable ordering by time)
+struct Replay_rec
+{
+    Trace_rec rec;
+    size_t    seq;
+};
+
+/// \brief Latency statistics of one operation type
+struct Replay_stats
+{
+    uint64_t count;
+    uint64_t errors;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t hist[LAT_BUCKETS];
+};
+
+static const char* const OP_NAMES[] = {"", "init", "push", "pop", "dstr"};
+const int OP_NUM = sizeof(OP_NAMES) / sizeof(OP_NAMES[0]);
+
+static uint64_t time_ns_()
+{
+    timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static int bucket_(uint64_t ns)
+{
+    int bucket = 0;
+    while(ns && bucket < LAT_BUCKETS - 1)
+    {
+        ns >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+/// \brief Upper bound of latency percentile (from histogram)
+static uint64_t percentile_(const Replay_stats* stats, double part)
+{
+    uint64_t rank = (uint64_t) (stats->count * part);
+    uint64_t seen = 0;
+
+    for(int bucket = 0; bucket < LAT_BUCKETS; bucket++)
+    {
+        seen += stats->hist[bucket];
+        if(seen > rank)
+            return bucket ? (1ULL << bucket) - 1 : 0;
+    }
+
+    return stats->max_ns;
+}
+
+static int compare_recs_(const void* lhs, const void* rhs)
+{
+    const Replay_rec* left  = (const Replay_rec*) lhs;
+    const Replay_rec* right = (const Replay_rec*) rhs;
+
+    if(left->rec.time_ns != right->rec.time_ns)
+        return left->rec.time_ns < right->rec.time_ns ? -1 : 1;
+
+    return left->seq < right->seq ? -1 : (left->seq > right->seq);
+}
+
+/// \brief Reads whole trace (so reading does not affect measurements)
+static Replay_rec* load_trace_(const char path[], size_t* nrecs, uint64_t* max_id)
+{
+    FILE* stream = fopen(path, "rb");
+    if(!stream)
+    {
+        perror("Can't open trace file");
+        return nullptr;
+    }
+
+    static Trace_reader reader;
+    if(trace_open(&reader, stream) != 0)
+    {
+        fprintf(stderr, "%s is not a trace of stack with this Elem_t\n", path);
+        fclose(stream);
+        return nullptr;
+    }
+
+    Replay_rec* recs = nullptr;
+    size_t cap = 0;
+    int status = 0;
+
+    *nrecs  = 0;
+    *max_id = 0;
+
+    Trace_rec rec = {};
+    while((status = trace_read(&reader, &rec)) == 1)
+    {
+        if(*nrecs == cap)
+        {
+            cap = cap ? cap * 2 : 1024;
+
+            Replay_rec* temp = (Replay_rec*) realloc(recs, cap * sizeof(Replay_rec));
+            if(!temp)
+            {
+                fprintf(stderr, "Not enough memory for trace\n");
+                free(recs);
+                fclose(stream);
+                return nullptr;
+            }
+            recs = temp;
+        }
+
+        recs[*nrecs].rec = rec;
+        recs[*nrecs].seq = *nrecs;
+        (*nrecs)++;
+
+        if(rec.id > *max_id)
+            *max_id = rec.id;
+    }
+
+    if(status < 0)
+        fprintf(stderr, "Trace is truncated or corrupted, replaying %zu records read before\n", *nrecs);
+
+    fclose(stream);
+
+    // Blocks of different threads are written out of order
+    qsort(recs, *nrecs, sizeof(Replay_rec), &compare_recs_);
+
+    return recs;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <trace file>\n", argv[0]);
+        return 1;
+    }
+
+    size_t   nrecs  = 0;
+    uint64_t max_id = 0;
+
+    Replay_rec* recs = load_trace_(argv[1], &nrecs, &max_id);
+    if(!recs)
+        return 1;
+
+    Stack* stks = (Stack*) aligned_alloc(STACK_LINE_SZ, (max_id + 1) * sizeof(Stack));
+    bool*  live = (bool*)  calloc(max_id + 1, sizeof(bool));
+    if(!stks || !live)
+    {
+        fprintf(stderr, "Not enough memory for %llu stacks\n", (unsigned long long) max_id + 1);
+        return 1;
+    }
+    memset((void*) stks, 0, (max_id + 1) * sizeof(Stack));
+
+    Replay_stats stats[OP_NUM] = {};
+
+    const int TIMER_ITERS = 1000;
+
+    uint64_t timer_ns = time_ns_();
+    for(int i = 0; i < TIMER_ITERS; i++)
+        time_ns_();
+    timer_ns = (time_ns_() - timer_ns) / TIMER_ITERS;
+
+    uint64_t replay_ns = 0;
+
+    for(size_t i = 0; i < nrecs; i++)
+    {
+        const Trace_rec* rec = &recs[i].rec;
+        Stack* stk = &stks[rec->id];
+
+        // Stack created before trace was started (or not initialized at all) is initialized empty
+        if(!live[rec->id] && rec->op != TRACE_INIT)
+        {
+            *stk = {};
+            stack_init(stk, 0);
+            live[rec->id] = true;
+        }
+        if(live[rec->id] && rec->op == TRACE_INIT)
+        {
+            stack_dstr(stk);
+            *stk = {};
+        }
+
+        Stack_err err = Stack_err::NOERR;
+        Elem_t elem = {};
+
+        uint64_t start = time_ns_();
+
+        switch(rec->op)
+        {
+            case TRACE_INIT:
+                err = stack_init(stk, (ssize_t) rec->capacity);
+                break;
+            case TRACE_PUSH:
+                err = stack_push(stk, rec->elem);
+                break;
+            case TRACE_POP:
+                err = stack_pop(stk, &elem);
+                break;
+            case TRACE_DSTR:
+                err = stack_dstr(stk);
+                break;
+            default:
+                break;
+        }
+
+        uint64_t elapsed = time_ns_() - start;
+
+        live[rec->id] = rec->op != TRACE_DSTR;
+        if(rec->op == TRACE_DSTR)
+            *stk = {};
+
+        Replay_stats* op_stats = &stats[rec->op];
+        op_stats->count++;
+        op_stats->errors   += err != Stack_err::NOERR;
+        op_stats->total_ns += elapsed;
+        op_stats->max_ns    = elapsed > op_stats->max_ns ? elapsed : op_stats->max_ns;
+        op_stats->hist[bucket_(elapsed)]++;
+
+        replay_ns += elapsed;
+    }
+
+    for(uint64_t id = 0; id <= max_id; id++)
+        if(live[id])
+            stack_dstr(&stks[id]);
+
+    uint64_t trace_ns = nrecs ? recs[nrecs - 1].rec.time_ns - recs[0].rec.time_ns : 0;
+
+    printf("records:     %zu (%llu stacks)\n", nrecs, (unsigned long long) max_id);
+    printf("traced time: %.3f ms\n", trace_ns / 1e6);
+    printf("replay time: %.3f ms (%.3f Mops/s), timer overhead %llu ns per op\n",
+           replay_ns / 1e6, replay_ns ? nrecs * 1e3 / replay_ns : 0.0, (unsigned long long) timer_ns);
+
+    printf("\n%-6s %12s %8s %10s %10s %10s %10s\n", "op", "count", "errors", "mean ns", "p50 ns", "p99 ns", "max ns");
+    for(int op = TRACE_INIT; op < OP_NUM; op++)
+    {
+        const Replay_stats* op_stats = &stats[op];
+        if(!op_stats->count)
+            continue;
+
+        printf("%-6s %12llu %8llu %10.1f %10llu %10llu %10llu\n", OP_NAMES[op],
+               (unsigned long long) op_stats->count, (unsigned long long) op_stats->errors,
+               (double) op_stats->total_ns / op_stats->count,
+               (unsigned long long) percentile_(op_stats, 0.5), (unsigned long long) percentile_(op_stats, 0.99),
+               (unsigned long long) op_stats->max_ns);
+    }
+
+    free(live);
+    free(stks);
+    free(recs);
+
+    return 0;
+}
@@ -0,0 +1,324 @@
+#include "include/config.h"
+#include "include/trace.h"
+
+#ifndef __USE_MINGW_ANSI_STDIO
+#define __USE_MINGW_ANSI_STDIO 1
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+
+/// \brief Size of block header (little-endian size of block)
+const size_t TRACE_BLK_HDR = 4;
+/// \brief Size of trace file header (magic, version, size of element)
+const size_t TRACE_FILE_HDR = sizeof(TRACE_MAGIC) + 2;
+
+static bool trace_get_varint_(Trace_reader* reader, uint64_t* val);
+
+////////////////////////////////////////////////////////////////
+#ifdef TRACE
+/// \brief Maximal size of one record
+const size_t TRACE_REC_MAX = 1 + 2 * 10 + (sizeof(Elem_t) > 10 ? sizeof(Elem_t) : 10);
+
+enum Trace_state
+{
+    TRACE_CLOSED  = 0,
+    TRACE_OPENING = 1,
+    TRACE_OPENED  = 2,
+    TRACE_FAILED  = 3,
+};
+
+static void trace_flush_(struct Trace_buf* buf);
+
+/// \brief Block of records of one thread
+struct Trace_buf
+{
+    size_t   len     = TRACE_BLK_HDR;
+    uint64_t time_ns = 0; ///< time of previous record in block
+
+    unsigned char data[TRACE_BLOCK_SZ];
+
+    ~Trace_buf()
+    {
+        trace_flush_(this);
+    }
+};
+
+static FILE*    TRACE_STREAM  = nullptr;
+static bool     TRACE_OWNED   = false;
+static int      TRACE_STATE   = TRACE_CLOSED;
+static uint64_t TRACE_BEG_NS  = 0;
+static uint64_t TRACE_LAST_ID = 0;
+
+static thread_local Trace_buf TRACE_BUF;
+
+static unsigned char* trace_put_varint_(unsigned char* ptr, uint64_t val)
+{
+    assert(ptr);
+
+    while(val >= 0x80)
+    {
+        *ptr++ = (unsigned char) (val | 0x80);
+        val >>= 7;
+    }
+    *ptr++ = (unsigned char) val;
+
+    return ptr;
+}
+
+static uint64_t trace_time_ns_()
+{
+    timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void close_tracefile_()
+{
+    if(!TRACE_OWNED)
+    {
+        fflush(TRACE_STREAM);
+        return;
+    }
+
+    if(fclose(TRACE_STREAM) != 0)
+        perror("Stack trace file can't be succesfully closed");
+}
+
+/// \brief Opens trace once (stream is used if not nullptr, STACK_TRACEFILE otherwise)
+static FILE* trace_stream_(FILE* stream)
+{
+    int state = __atomic_load_n(&TRACE_STATE, __ATOMIC_ACQUIRE);
+    if(state == TRACE_OPENED)
+        return TRACE_STREAM;
+
+    int closed = TRACE_CLOSED;
+    if(state == TRACE_CLOSED &&
+       __atomic_compare_exchange_n(&TRACE_STATE, &closed, TRACE_OPENING, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        TRACE_STREAM = stream;
+        if(!TRACE_STREAM)
+        {
+            TRACE_STREAM = fopen(STACK_TRACEFILE, "wb");
+            TRACE_OWNED  = true;
+        }
+
+        unsigned char header[TRACE_FILE_HDR] = {};
+        memcpy(header, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        header[sizeof(TRACE_MAGIC)]     = TRACE_VER;
+        header[sizeof(TRACE_MAGIC) + 1] = sizeof(Elem_t);
+
+        if(!TRACE_STREAM || fwrite(header, 1, sizeof(header), TRACE_STREAM) != sizeof(header))
+        {
+            perror("Can't open trace file");
+            __atomic_store_n(&TRACE_STATE, TRACE_FAILED, __ATOMIC_RELEASE);
+
+            return nullptr;
+        }
+
+        TRACE_BEG_NS = trace_time_ns_();
+        atexit(&close_tracefile_);
+
+        __atomic_store_n(&TRACE_STATE, TRACE_OPENED, __ATOMIC_RELEASE);
+
+        return TRACE_STREAM;
+    }
+
+    // Other thread is opening trace
+    while((state = __atomic_load_n(&TRACE_STATE, __ATOMIC_ACQUIRE)) == TRACE_OPENING)
+        ;
+
+    return state == TRACE_OPENED ? TRACE_STREAM : nullptr;
+}
+
+static void trace_flush_(Trace_buf* buf)
+{
+    assert(buf);
+
+    if(buf->len == TRACE_BLK_HDR || !trace_stream_(nullptr))
+        return;
+
+    size_t nbytes = buf->len - TRACE_BLK_HDR;
+    for(size_t i = 0; i < TRACE_BLK_HDR; i++)
+        buf->data[i] = (unsigned char) (nbytes >> (8 * i));
+
+    // Single fwrite keeps blocks of different threads from interleaving
+    if(fwrite(buf->data, 1, buf->len, TRACE_STREAM) != buf->len)
+        perror("Can't write to trace file");
+
+    buf->len     = TRACE_BLK_HDR;
+    buf->time_ns = 0;
+}
+
+void stack_trace_init(FILE* tracestream)
+{
+    trace_stream_(tracestream);
+}
+
+void stack_trace_flush()
+{
+    trace_flush_(&TRACE_BUF);
+
+    if(TRACE_STREAM)
+        fflush(TRACE_STREAM);
+}
+
+uint64_t trace_new_id_()
+{
+    return __atomic_add_fetch(&TRACE_LAST_ID, 1, __ATOMIC_RELAXED);
+}
+
+void trace_op_(Trace_op op, uint64_t id, const Elem_t* elem, size_t capacity)
+{
+    if(!trace_stream_(nullptr))
+        return;
+
+    Trace_buf* buf = &TRACE_BUF;
+
+    if(buf->len + TRACE_REC_MAX > TRACE_BLOCK_SZ)
+        trace_flush_(buf);
+
+    uint64_t now = trace_time_ns_() - TRACE_BEG_NS;
+
+    unsigned char* ptr = buf->data + buf->len;
+
+    *ptr++ = (unsigned char) op;
+    ptr = trace_put_varint_(ptr, id);
+    ptr = trace_put_varint_(ptr, now - buf->time_ns);
+
+    if(op == TRACE_INIT)
+        ptr = trace_put_varint_(ptr, capacity);
+    else if(op == TRACE_PUSH)
+    {
+        assert(elem);
+
+        memcpy(ptr, elem, sizeof(Elem_t));
+        ptr += sizeof(Elem_t);
+    }
+
+    buf->len     = ptr - buf->data;
+    buf->time_ns = now;
+}
+
+#else // TRACE
+
+void stack_trace_init(FILE* tracestream)
+{
+    (void) tracestream;
+}
+
+void stack_trace_flush()
+{
+    void(0);
+}
+#endif // TRACE ////////////////////////////////////////////////
+
+int trace_open(Trace_reader* reader, FILE* stream)
+{
+    assert(reader && stream);
+
+    unsigned char header[TRACE_FILE_HDR] = {};
+
+    if(fread(header, 1, sizeof(header), stream) != sizeof(header))
+        return -1;
+
+    if(memcmp(header, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+       header[sizeof(TRACE_MAGIC)] != TRACE_VER || header[sizeof(TRACE_MAGIC) + 1] != sizeof(Elem_t))
+        return -1;
+
+    reader->stream  = stream;
+    reader->len     = 0;
+    reader->pos     = 0;
+    reader->time_ns = 0;
+
+    return 0;
+}
+
+int trace_read(Trace_reader* reader, Trace_rec* rec)
+{
+    assert(reader && rec);
+
+    if(reader->pos == reader->len)
+    {
+        unsigned char header[TRACE_BLK_HDR] = {};
+
+        size_t nread = fread(header, 1, sizeof(header), reader->stream);
+        if(nread == 0)
+            return 0;
+        if(nread != sizeof(header))
+            return -1;
+
+        size_t nbytes = 0;
+        for(size_t i = 0; i < TRACE_BLK_HDR; i++)
+            nbytes |= (size_t) header[i] << (8 * i);
+
+        if(nbytes == 0 || nbytes > TRACE_BLOCK_SZ - TRACE_BLK_HDR ||
+           fread(reader->block, 1, nbytes, reader->stream) != nbytes)
+            return -1;
+
+        reader->len     = nbytes;
+        reader->pos     = 0;
+        reader->time_ns = 0;
+    }
+
+    *rec = {};
+    rec->op = reader->block[reader->pos++];
+
+    uint64_t delta = 0;
+    if(!trace_get_varint_(reader, &rec->id) || !trace_get_varint_(reader, &delta))
+        return -1;
+
+    reader->time_ns += delta;
+    rec->time_ns     = reader->time_ns;
+
+    switch(rec->op)
+    {
+        case TRACE_INIT:
+        {
+            uint64_t capacity = 0;
+            if(!trace_get_varint_(reader, &capacity))
+                return -1;
+
+            rec->capacity = capacity;
+            break;
+        }
+        case TRACE_PUSH:
+            if(reader->len - reader->pos < sizeof(Elem_t))
+                return -1;
+
+            memcpy(&rec->elem, reader->block + reader->pos, sizeof(Elem_t));
+            reader->pos += sizeof(Elem_t);
+            break;
+        case TRACE_POP:
+        case TRACE_DSTR:
+            break;
+        default:
+            return -1;
+    }
+
+    return 1;
+}
+
+static bool trace_get_varint_(Trace_reader* reader, uint64_t* val)
+{
+    assert(reader && val);
+
+    *val = 0;
+
+    for(int shift = 0; shift < 64; shift += 7)
+    {
+        if(reader->pos == reader->len)
+            return false;
+
+        unsigned char byte = reader->block[reader->pos++];
+        *val |= (uint64_t) (byte & 0x7F) << shift;
+
+        if(!(byte & 0x80))
+            return true;
+    }
+
+    return false;
+}